@@ -0,0 +1,108 @@
+/**
+ * @file drv_gd32f10x_flash.c
+ * @author salalei (1028609078@qq.com)
+ * @brief gd32f10x的片上flash驱动程序
+ * @version 0.1
+ * @date 2022-03-05
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+#include "board.h"
+#ifdef bool
+#undef bool
+#endif
+#include "ll_flash.h"
+#include "ll_init.h"
+
+#include <string.h>
+
+#define PAGE_SIZE 1024 //中容量产品每页1KB
+
+//由链接脚本提供的校准参数区域
+extern const uint8_t __calib_start[];
+extern const uint8_t __calib_size[];
+
+struct gd32f10x_flash_handle
+{
+    struct ll_flash parent;
+    uint32_t start;
+};
+
+static int _read(struct ll_flash *flash, uint32_t offset, void *buf, size_t size)
+{
+    struct gd32f10x_flash_handle *handle = (struct gd32f10x_flash_handle *)flash;
+
+    memcpy(buf, (const void *)(handle->start + offset), size);
+    return 0;
+}
+
+static int _write(struct ll_flash *flash, uint32_t offset, const void *buf, size_t size)
+{
+    struct gd32f10x_flash_handle *handle = (struct gd32f10x_flash_handle *)flash;
+    const uint8_t *p = (const uint8_t *)buf;
+    uint32_t addr = handle->start + offset;
+    uint16_t data;
+    int res = 0;
+
+    fmc_unlock();
+    fmc_flag_clear(FMC_FLAG_BANK0_END | FMC_FLAG_BANK0_WPERR | FMC_FLAG_BANK0_PGERR);
+    while (size)
+    {
+        //按半字写入，源数据不要求对齐
+        data = p[0] | (size > 1 ? p[1] << 8 : 0xff00);
+        if (fmc_halfword_program(addr, data) != FMC_READY)
+        {
+            res = -EIO;
+            break;
+        }
+        fmc_flag_clear(FMC_FLAG_BANK0_END | FMC_FLAG_BANK0_WPERR | FMC_FLAG_BANK0_PGERR);
+        addr += 2;
+        p += 2;
+        size = size > 1 ? size - 2 : 0;
+    }
+    fmc_lock();
+
+    return res;
+}
+
+static int _erase(struct ll_flash *flash, uint32_t offset, size_t size)
+{
+    struct gd32f10x_flash_handle *handle = (struct gd32f10x_flash_handle *)flash;
+    uint32_t addr = handle->start + offset;
+    int res = 0;
+
+    fmc_unlock();
+    fmc_flag_clear(FMC_FLAG_BANK0_END | FMC_FLAG_BANK0_WPERR | FMC_FLAG_BANK0_PGERR);
+    for (; size; size -= PAGE_SIZE, addr += PAGE_SIZE)
+    {
+        if (fmc_page_erase(addr) != FMC_READY)
+        {
+            res = -EIO;
+            break;
+        }
+        fmc_flag_clear(FMC_FLAG_BANK0_END | FMC_FLAG_BANK0_WPERR | FMC_FLAG_BANK0_PGERR);
+    }
+    fmc_lock();
+
+    return res;
+}
+
+const static struct ll_flash_ops ops = {
+    .read = _read,
+    .write = _write,
+    .erase = _erase,
+};
+
+static int bsp_flash_init(void)
+{
+    static struct gd32f10x_flash_handle calib;
+
+    calib.start = (uint32_t)__calib_start;
+    calib.parent.ops = &ops;
+    calib.parent.size = (size_t)__calib_size;
+    calib.parent.erase_size = PAGE_SIZE;
+    calib.parent.write_size = 2;
+    return __ll_flash_register(&calib.parent, "calib", NULL);
+}
+LL_BOARD_INITCALL(bsp_flash_init);
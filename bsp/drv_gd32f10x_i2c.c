@@ -35,6 +35,7 @@ struct gd32f10x_i2c_handle
     uint32_t send_dma;
     dma_channel_enum send_dma_ch;
     TaskHandle_t thread;
+    uint32_t speed_hz; //当前的通信速率
 };
 
 static int i2c_wait(struct gd32f10x_i2c_handle *handle, i2c_flag_enum flag, FlagStatus status)
@@ -226,12 +227,29 @@ static void i2c_bus_reset(struct gd32f10x_i2c_handle *handle)
     gpio_bit_set(handle->sda_gpio, handle->sda_pin);
     gpio_init(handle->scl_gpio, GPIO_MODE_AF_OD, GPIO_OSPEED_50MHZ, handle->scl_pin);
     gpio_init(handle->sda_gpio, GPIO_MODE_AF_OD, GPIO_OSPEED_50MHZ, handle->sda_pin);
-    i2c_clock_config(handle->i2c, 400000, I2C_DTCY_2);
+    i2c_clock_config(handle->i2c, handle->speed_hz, I2C_DTCY_2);
     i2c_mode_addr_config(handle->i2c, I2C_I2CMODE_ENABLE, I2C_ADDFORMAT_7BITS, 0x00);
     i2c_enable(handle->i2c);
     i2c_ack_config(handle->i2c, I2C_ACK_ENABLE);
 }
 
+/**
+ * @brief 与上一次通信的设备速率不同时重新配置总线时钟
+ *
+ * @param handle 指向i2c句柄
+ * @param speed_hz 需要的通信速率
+ */
+static void i2c_set_speed(struct gd32f10x_i2c_handle *handle, uint32_t speed_hz)
+{
+    if (handle->speed_hz == speed_hz)
+        return;
+    handle->speed_hz = speed_hz;
+    i2c_disable(handle->i2c);
+    i2c_clock_config(handle->i2c, speed_hz, I2C_DTCY_2);
+    i2c_enable(handle->i2c);
+    i2c_ack_config(handle->i2c, I2C_ACK_ENABLE);
+}
+
 static ssize_t master_block_xfer(struct ll_i2c_dev *dev, struct ll_i2c_msg *msgs, size_t numb)
 {
     int res;
@@ -239,6 +257,7 @@ static ssize_t master_block_xfer(struct ll_i2c_dev *dev, struct ll_i2c_msg *msgs
     struct gd32f10x_i2c_handle *handle = (struct gd32f10x_i2c_handle *)(dev->i2c);
     size_t i;
 
+    i2c_set_speed(handle, __ll_i2c_get_speed(dev));
     for (i = 0; i < numb; i++)
     {
         msg = &msgs[i];
@@ -294,7 +313,7 @@ static void __i2c_init(struct gd32f10x_i2c_handle *handle)
 
     gpio_init(handle->scl_gpio, GPIO_MODE_AF_OD, GPIO_OSPEED_50MHZ, handle->scl_pin);
     gpio_init(handle->sda_gpio, GPIO_MODE_AF_OD, GPIO_OSPEED_50MHZ, handle->sda_pin);
-    i2c_clock_config(handle->i2c, 400000, I2C_DTCY_2);
+    i2c_clock_config(handle->i2c, handle->speed_hz, I2C_DTCY_2);
     i2c_mode_addr_config(handle->i2c, I2C_I2CMODE_ENABLE, I2C_ADDFORMAT_7BITS, 0x00);
     i2c_enable(handle->i2c);
     i2c_ack_config(handle->i2c, I2C_ACK_ENABLE);
@@ -362,7 +381,9 @@ static int bsp_i2c_init(void)
     i2c0.recv_dma_ch = DMA_CH6;
     i2c0.send_dma = DMA0;
     i2c0.send_dma_ch = DMA_CH5;
+    i2c0.speed_hz = LL_I2C_DEFAULT_SPEED_HZ;
     i2c0.parent.ops = &ops;
+    i2c0.parent.max_speed_hz = LL_I2C_DEFAULT_SPEED_HZ; //gd32f10x的i2c只支持标准和快速模式
     rcu_periph_clock_enable(RCU_GPIOB);
     rcu_periph_clock_enable(RCU_I2C0);
     rcu_periph_clock_enable(RCU_DMA0);
@@ -39,6 +39,34 @@ static ssize_t master_send(struct ll_spi_bus *bus, const void *buf, size_t size)
     return size;
 }
 
+static ssize_t poll_send(struct ll_spi_bus *bus, const void *buf, size_t size)
+{
+    struct gd32f10x_spi_handle *handle = (struct gd32f10x_spi_handle *)bus;
+    size_t i;
+
+    if (handle->conf.frame_bits == __LL_SPI_FRAME_8BIT)
+    {
+        for (i = 0; i < size; i++)
+        {
+            while (!spi_i2s_flag_get(handle->spi, SPI_FLAG_TBE))
+                ;
+            spi_i2s_data_transmit(handle->spi, ((const uint8_t *)buf)[i]);
+        }
+    }
+    else
+    {
+        for (i = 0; i < size / 2; i++)
+        {
+            while (!spi_i2s_flag_get(handle->spi, SPI_FLAG_TBE))
+                ;
+            spi_i2s_data_transmit(handle->spi, ((const uint16_t *)buf)[i]);
+        }
+    }
+    while (!spi_i2s_flag_get(handle->spi, SPI_FLAG_TBE) || spi_i2s_flag_get(handle->spi, SPI_FLAG_TRANS))
+        ;
+    return size;
+}
+
 static void hard_cs_ctrl(struct ll_spi_bus *bus, bool state)
 {
     struct gd32f10x_spi_handle *handle = (struct gd32f10x_spi_handle *)bus;
@@ -163,6 +191,7 @@ static int config(struct ll_spi_bus *bus, struct ll_spi_conf *conf)
 
 const static struct ll_spi_ops ops = {
     .master_send = master_send,
+    .poll_send = poll_send,
     .hard_cs_ctrl = hard_cs_ctrl,
     .config = config,
 };
@@ -175,6 +204,9 @@ static void spi_irq_handler(struct gd32f10x_spi_handle *handle)
     {
         dma_interrupt_flag_clear(handle->send_dma, handle->send_dma_ch, DMA_INT_FLAG_FTF);
         dma_channel_disable(handle->send_dma, handle->send_dma_ch);
+        //dma完成时最后的数据还在移位，等发送完再切换片选和dc引脚
+        while (!spi_i2s_flag_get(handle->spi, SPI_FLAG_TBE) || spi_i2s_flag_get(handle->spi, SPI_FLAG_TRANS))
+            ;
         __ll_spi_irq_handler(handle->parent.dev);
     }
 }
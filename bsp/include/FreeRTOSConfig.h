@@ -21,7 +21,7 @@
 #define configUSE_16_BIT_TICKS                0
 #define configIDLE_SHOULD_YIELD               1
 #define configUSE_TASK_NOTIFICATIONS          1
-#define configTASK_NOTIFICATION_ARRAY_ENTRIES 2
+#define configTASK_NOTIFICATION_ARRAY_ENTRIES 3
 #define configUSE_MUTEXES                     1
 
 #define configSUPPORT_STATIC_ALLOCATION  0
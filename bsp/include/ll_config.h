@@ -29,4 +29,7 @@
 
 // #define LL_USING_ASSERT
 
+// #define LL_MLX90640_USING_FIXED_POINT
+#define LL_MLX90640_USING_COMPACT_PARAMS
+
 #endif
\ No newline at end of file
@@ -15,12 +15,24 @@
 #include "ll_pin.h"
 #include "ll_spi.h"
 
+#ifndef LL_0_96_LCD_PATTERN_SIZE
+#define LL_0_96_LCD_PATTERN_SIZE 64 //无阻塞单色填充时每次发送的像素个数
+#endif
+
 struct lcd_0_96_drv
 {
     struct ll_disp_drv parent;
     struct ll_spi_dev dev;
     struct ll_pin *res_pin;
     struct ll_pin *dc_pin;
+    //无阻塞填充时，设置窗口、写显存命令和数据作为一条消息发送
+    struct ll_spi_trans trans[6]; //设置窗口的5个传输和1个数据传输
+    struct ll_spi_msg msg[2]; //单色填充时剩余的数据在完成中断里继续发送，两条消息轮流使用
+    uint8_t index;
+    volatile uint8_t busy;
+    uint8_t addr[4]; //列、行的起止地址
+    size_t remain;   //单色填充还未发送的字节数
+    uint16_t pattern[LL_0_96_LCD_PATTERN_SIZE];
 };
 
 int ll_0_96_lcd_init(struct lcd_0_96_drv *lcd_drv,
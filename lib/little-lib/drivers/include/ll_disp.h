@@ -38,6 +38,8 @@ enum ll_disp_dir
 };
 
 struct ll_disp_drv;
+struct tskTaskControlBlock;
+typedef struct tskTaskControlBlock *TaskHandle_t;
 
 struct ll_disp_rect
 {
@@ -69,6 +71,8 @@ struct ll_disp_drv
     uint16_t height;
     void (*fill_cb)(void *priv);
     void *priv;
+    TaskHandle_t thread; //ll_disp_render等待异步填充完成的线程
+    int fill_result;     //最近一次异步填充的结果
 };
 
 /**
@@ -116,7 +120,7 @@ static inline uint16_t ll_disp_get_hight(struct ll_disp_drv *disp)
     return disp->height;
 }
 
-void __ll_ll_disp_fill_complete(struct ll_disp_drv *disp);
+void __ll_disp_fill_complete(struct ll_disp_drv *disp, int res);
 int __ll_disp_register(struct ll_disp_drv *disp,
                        const char *name,
                        void *priv,
@@ -126,6 +130,12 @@ int ll_disp_init(struct ll_disp_drv *disp, int mode);
 int ll_disp_deinit(struct ll_disp_drv *disp);
 int ll_disp_fill(struct ll_disp_drv *disp, const struct ll_disp_rect *rect, void *color);
 int ll_disp_fill_color(struct ll_disp_drv *disp, const struct ll_disp_rect *rect, void *color);
+int ll_disp_render(struct ll_disp_drv *disp,
+                   const struct ll_disp_rect *rect,
+                   void *buf,
+                   size_t size,
+                   int (*render)(void *priv, const struct ll_disp_rect *band, void *buf),
+                   void *priv);
 int ll_disp_draw_point(struct ll_disp_drv *disp, uint16_t x, uint16_t y, void *color);
 int ll_disp_draw_hline(struct ll_disp_drv *disp, uint16_t x1, uint16_t y, uint16_t x2, void *color);
 int ll_disp_draw_vline(struct ll_disp_drv *disp, uint16_t x, uint16_t y1, uint16_t y2, void *color);
@@ -0,0 +1,55 @@
+/**
+ * @file ll_flash.h
+ * @author salalei (1028609078@qq.com)
+ * @brief 片上flash驱动框架
+ * @version 0.1
+ * @date 2022-03-05
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+#ifndef __LL_FLASH_H__
+#define __LL_FLASH_H__
+
+#include "ll_drv.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct ll_flash;
+
+/**
+ * @brief flash驱动接口，地址均为相对于该区域起始地址的偏移
+ */
+struct ll_flash_ops
+{
+    int (*read)(struct ll_flash *flash, uint32_t offset, void *buf, size_t size);
+    int (*write)(struct ll_flash *flash, uint32_t offset, const void *buf, size_t size);
+    int (*erase)(struct ll_flash *flash, uint32_t offset, size_t size);
+};
+
+/**
+ * @brief 一块flash区域
+ */
+struct ll_flash
+{
+    struct ll_drv parent;
+    const struct ll_flash_ops *ops;
+    size_t size;       //区域大小
+    size_t erase_size; //最小擦除单位
+    size_t write_size; //最小写入单位
+};
+
+int __ll_flash_register(struct ll_flash *flash,
+                        const char *name,
+                        void *priv);
+int ll_flash_read(struct ll_flash *flash, uint32_t offset, void *buf, size_t size);
+int ll_flash_write(struct ll_flash *flash, uint32_t offset, const void *buf, size_t size);
+int ll_flash_erase(struct ll_flash *flash, uint32_t offset, size_t size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -16,6 +16,10 @@
 #define __LL_I2C_DIR_SEND 0
 #define __LL_I2C_DIR_RECV 1
 
+#ifndef LL_I2C_DEFAULT_SPEED_HZ
+#define LL_I2C_DEFAULT_SPEED_HZ 400000 //设备未指定速率时使用的速率
+#endif
+
 struct ll_i2c_bus;
 typedef struct QueueDefinition *QueueHandle_t;
 typedef QueueHandle_t SemaphoreHandle_t;
@@ -36,6 +40,7 @@ struct ll_i2c_dev
     struct ll_drv parent;
     struct ll_i2c_bus *i2c;
     uint16_t addr;
+    uint32_t max_speed_hz; //设备支持的最高速率，为0时使用LL_I2C_DEFAULT_SPEED_HZ
 };
 
 struct ll_i2c_ops
@@ -48,6 +53,7 @@ struct ll_i2c_bus
     struct ll_drv parent;
     const struct ll_i2c_ops *ops;
     struct ll_list_node dev_head;
+    uint32_t max_speed_hz; //总线支持的最高速率
 
     SemaphoreHandle_t lock;
 };
@@ -57,6 +63,18 @@ int __ll_i2c_bus_register(struct ll_i2c_bus *i2c,
                           void *priv,
                           int drv_mode);
 
+/**
+ * @brief 获取与指定设备通信时使用的速率(供底层驱动使用)
+ *
+ * @param dev 指向i2c设备的指针
+ * @return uint32_t 设备和总线都支持的最高速率
+ */
+static inline uint32_t __ll_i2c_get_speed(struct ll_i2c_dev *dev)
+{
+    uint32_t speed = dev->max_speed_hz ? dev->max_speed_hz : LL_I2C_DEFAULT_SPEED_HZ;
+    return speed < dev->i2c->max_speed_hz ? speed : dev->i2c->max_speed_hz;
+}
+
 ssize_t ll_i2c_trans(struct ll_i2c_dev *dev, struct ll_i2c_msg *msgs, size_t numb);
 int ll_i2c_bus_init(struct ll_i2c_bus *bus);
 int ll_i2c_bus_deinit(struct ll_i2c_bus *bus);
@@ -13,6 +13,30 @@
 
 #include "ll_i2c.h"
 
+#ifdef LL_MLX90640_USING_FIXED_POINT
+/**
+ * @brief 定点模式下温度以Q6格式(1/64℃)保存，范围±511℃
+ */
+#define LL_MLX90640_TEMP_FRAC_BITS 6
+typedef int16_t ll_mlx90640_temp_t;
+typedef int32_t ll_mlx90640_coef_t;
+#define LL_MLX90640_TEMP_FROM_FLOAT(x) ((ll_mlx90640_temp_t)((x) * (1 << LL_MLX90640_TEMP_FRAC_BITS)))
+#define LL_MLX90640_TEMP_TO_FLOAT(x)   ((float)(x) / (1 << LL_MLX90640_TEMP_FRAC_BITS))
+#else
+typedef float ll_mlx90640_temp_t;
+typedef float ll_mlx90640_coef_t;
+#define LL_MLX90640_TEMP_FROM_FLOAT(x) ((ll_mlx90640_temp_t)(x))
+#define LL_MLX90640_TEMP_TO_FLOAT(x)   ((float)(x))
+#endif
+
+#ifndef LL_MLX90640_MAX_BAD_PIXELS
+#define LL_MLX90640_MAX_BAD_PIXELS 4 //手册规定坏点和异常点最多4个
+#endif
+
+#ifndef LL_MLX90640_HIST_BINS
+#define LL_MLX90640_HIST_BINS 16 //帧统计中直方图的区间数
+#endif
+
 enum ll_mlx90640_rate
 {
     LL_MLX90640_RATE_0_5 = 0,
@@ -26,10 +50,46 @@ enum ll_mlx90640_rate
     LL_MLX90640_RATE_LIMIT,
 };
 
+/**
+ * @brief ram的读取模式
+ *
+ * 采集服务每个子界面只读取该子界面的像素：隔行模式下只读取一半的行，i2c的数据量约减半；
+ * 棋盘模式下两个子界面的像素在每行交替分布，分段读取的开销大于节省的数据量，仍需读取几乎整个ram，
+ * i2c带宽不足时应使用隔行模式，刷新率调节器可以在i2c占用过高时自动切换(ll_mlx90640_gov_conf::auto_pattern)
+ */
+enum ll_mlx90640_pattern
+{
+    LL_MLX90640_PATTERN_INTERLEAVED = 0,
+    LL_MLX90640_PATTERN_CHESS,
+};
+
+enum ll_mlx90640_resolution
+{
+    LL_MLX90640_RESOLUTION_16 = 0,
+    LL_MLX90640_RESOLUTION_17,
+    LL_MLX90640_RESOLUTION_18,
+    LL_MLX90640_RESOLUTION_19,
+    LL_MLX90640_RESOLUTION_LIMIT,
+};
+
+/**
+ * @brief 传感器的测量模式
+ */
+struct ll_mlx90640_mode
+{
+    enum ll_mlx90640_rate rate;
+    enum ll_mlx90640_resolution resolution; //adc分辨率，分辨率越高噪声越小
+    enum ll_mlx90640_pattern pattern;
+    uint8_t subpage_repeat;                 //1 只重复测量select_subpage指定的子界面
+    uint8_t select_subpage;
+    uint8_t data_hold;                      //1 读取ram期间禁止传感器覆盖ram数据
+};
+
 struct ll_mlx90640_ram_buf
 {
     uint16_t data[768];
     uint16_t params[64];
+    uint16_t ctrl; //测量时CTRL_REG的值，计算时用于确定分辨率和读取模式
 };
 
 struct ll_mlx90640_ee_buf
@@ -47,15 +107,31 @@ struct ll_mlx90640_fixed_params
     float k_tptat;
     float alpha_ptat;
 
+#ifdef LL_MLX90640_USING_COMPACT_PARAMS
+    /**
+     * 紧凑模式下每个像素的参数由行、列参数加上像素的余量得到，
+     * 余量直接保存eeprom中的像素数据：offset[15:10]，alpha[9:4]，kta[3:1]，outlier[0]
+     */
+    int16_t os_row[24];    //offset_avg + occ_row * 2^occ_scale_row
+    int16_t os_col[32];    //occ_col * 2^occ_scale_col
+    int16_t alpha_row[24]; //a_reference + acc_row * 2^acc_scale_row
+    int16_t alpha_col[32]; //acc_col * 2^acc_scale_col
+    int8_t kta_rc[2][2];
+    uint8_t os_scale_remnant;
+    uint8_t alpha_scale_remnant;
+    uint8_t kta_scale_2;
+    uint16_t pix[768];
+#else
     int16_t pix_os_ref[768];
     int16_t alpha[768];
+    int16_t kta[768];
+#endif
+    uint16_t alpha_inv[768]; //alpha归一化到[2^15, 2^16)后倒数的小数部分，用于不经除法求有效alpha的倒数
     uint8_t alpha_scale;
+    uint8_t kta_scale_1;
 
     float kv[2][2];
 
-    int16_t kta[768];
-    uint8_t kta_scale_1;
-
     int16_t gain;
     float ks_ta;
     int16_t ct[4];
@@ -66,29 +142,247 @@ struct ll_mlx90640_fixed_params
     float kv_cp;
     float kta_cp;
     float tgc;
+    float il_chess_c[3];   //读取模式与校准时不同时的补偿系数
+    uint8_t calib_pattern; //校准时使用的读取模式
     uint8_t resolution_ee;
+
+    uint8_t bad_pixel_numb;                                 //坏点和异常点的个数
+    uint8_t bad_pixel_nbr_numb[LL_MLX90640_MAX_BAD_PIXELS]; //可用于插值的相邻像素个数
+    uint16_t bad_pixel[LL_MLX90640_MAX_BAD_PIXELS];         //坏点的像素序号
+    uint16_t bad_pixel_nbr[LL_MLX90640_MAX_BAD_PIXELS][4];  //相邻像素的序号
+
+#ifdef LL_MLX90640_USING_FIXED_POINT
+    int32_t ct_q6[4];                //转折温度，Q6
+    int32_t ks_to_q30[4];            //ks_to，Q30
+    int32_t alpha_corr_range_q28[4]; //各温度区间的alpha修正，Q28
+#endif
 };
 
 struct ll_mlx90640_ir_data
 {
-    float temp[768];
+    ll_mlx90640_temp_t temp[768];
+};
+
+/**
+ * @brief 用于显示的调色板索引
+ */
+struct ll_mlx90640_palette_data
+{
+    uint8_t index[768];
+};
+
+/**
+ * @brief 采集服务的统计信息
+ */
+struct ll_mlx90640_acq_stat
+{
+    uint32_t frames;     //成功交给使用者的子帧数
+    uint32_t drops;      //使用者未释放缓存而丢弃的子帧数
+    uint32_t timeouts;   //等待数据超时的次数
+    uint32_t polls;      //查询STATUS_REG的总次数
+    uint32_t words;      //读取ram的总字数
+    uint32_t bus_ticks;  //读取ram所用的总tick数
+    uint16_t last_polls; //最近一帧查询STATUS_REG的次数
+    uint16_t max_polls;  //单帧查询STATUS_REG的最大次数
+};
+
+/**
+ * @brief 每个像素的有效offset和alpha的倒数的缓存，只在Ta、Vdd变化超过阈值时重新计算
+ */
+struct ll_mlx90640_coef_cache
+{
+    ll_mlx90640_coef_t offset[768]; //经过Ta、Vdd和发射率补偿的offset
+    ll_mlx90640_coef_t inv_alpha[768]; //经过补偿像素和Ta补偿的alpha的倒数，定点版本为归一化的倒数和移位数
+    float ta;                       //缓存对应的ΔTa
+    float vdd;                      //缓存对应的ΔVdd
+    float emissivity;               //缓存对应的发射率
+    uint8_t pattern;                //缓存对应的读取模式
+    float sweep_ta;
+    float sweep_vdd;
+    float ta_threshold;
+    float vdd_threshold;
+    uint8_t slice_rows;
+    uint8_t cursor;
+    uint8_t valid;
+    uint32_t hits;       //直接使用缓存的次数
+    uint32_t recomputes; //全部重新计算的次数
+};
+
+/**
+ * @brief 逐像素的时域IIR滤波器，历史数据即ll_mlx90640_ir_data中上一次的温度
+ *
+ * 新值与历史值之差不超过noise时按k_min滤波，超过motion时直接使用新值，两者之间滤波系数线性增大
+ */
+struct ll_mlx90640_filter
+{
+    uint16_t noise;   //噪声门限，Q6格式的℃
+    uint16_t motion;  //运动门限，Q6格式的℃
+    uint16_t slope;   //noise与motion之间每1/64℃增加的滤波系数，单位2^-16
+    uint8_t k_min;    //最小滤波系数，单位1/256
+    uint8_t primed;   //bit0、bit1分别表示子界面0、1已有历史数据
 };
 
+/**
+ * @brief 一帧的统计结果
+ */
+struct ll_mlx90640_frame_stats
+{
+    ll_mlx90640_temp_t min;
+    ll_mlx90640_temp_t max;
+    ll_mlx90640_temp_t mean;
+    uint16_t argmin; //最小值的像素序号
+    uint16_t argmax; //最大值的像素序号
+    uint16_t count;  //参与统计的像素个数
+    uint16_t hist[LL_MLX90640_HIST_BINS];
+};
+
+/**
+ * @brief 一个子界面的统计结果，两个子界面合并后得到整帧的结果
+ */
+struct ll_mlx90640_stats_part
+{
+    ll_mlx90640_temp_t min;
+    ll_mlx90640_temp_t max;
+    uint16_t argmin;
+    uint16_t argmax;
+    uint16_t count;
+    uint16_t hist[LL_MLX90640_HIST_BINS];
+#ifdef LL_MLX90640_USING_FIXED_POINT
+    int32_t sum;
+#else
+    float sum;
+#endif
+};
+
+/**
+ * @brief 帧统计，在计算温度的同时完成，不需要再遍历温度数据
+ */
+struct ll_mlx90640_stats
+{
+    struct ll_list_node node;
+    uint32_t mask[24];                   //参与统计的像素，每行一个字，bit n对应第n列，不包含坏点
+    uint8_t bad_roi;                     //在统计范围内的坏点，bit k对应fixed_params中的第k个坏点
+    ll_mlx90640_temp_t hist_min;         //直方图下限，低于下限的计入第一个区间
+    ll_mlx90640_coef_t hist_scale;       //每℃对应的区间数，定点模式下为每1/64℃对应的区间数，Q16
+    struct ll_mlx90640_stats_part part[2];
+    struct ll_mlx90640_frame_stats frame; //最近一次计算后整帧的统计结果
+};
+
+/**
+ * @brief 刷新率调节器的配置
+ */
+struct ll_mlx90640_gov_conf
+{
+    enum ll_mlx90640_rate min_rate;
+    enum ll_mlx90640_rate max_rate;
+    uint8_t headroom;     //需要保留的cpu余量，百分比，负载超过100 - headroom时降低刷新率
+    uint8_t hysteresis;   //提高刷新率时额外需要的余量，百分比
+    uint8_t up_hold;      //连续满足提高条件的评估次数
+    uint16_t interval;    //评估周期，单位ms
+    uint8_t auto_pattern; //1 i2c占用超过100 - headroom时先由棋盘模式切换到隔行模式，再降低刷新率
+};
+
+struct ll_flash;
+struct tskTaskControlBlock;
+typedef struct tskTaskControlBlock *TaskHandle_t;
+
 struct ll_mlx90640
 {
     struct ll_i2c_dev dev;
+    float emissivity;
+    struct ll_mlx90640_mode mode;     //当前的测量模式
+    struct ll_mlx90640_mode new_mode; //等待采集线程在帧边界应用的测量模式
+    volatile uint8_t mode_pending;
+    volatile uint8_t mode_skip; //丢弃切换模式时正在测量的子界面
+    struct ll_mlx90640_coef_cache *coef_cache;
+    struct ll_mlx90640_filter *filter;
+    struct ll_list_node stats_head;
+    uint8_t lazy;            //1 只计算lazy_mask、帧统计和坏点插值需要的像素
+    uint32_t lazy_mask[24];  //每行一个字，bit n对应第n列
+    uint32_t lazy_stale[24]; //懒计算模式下曾经没有计算、历史值已过期的像素，再次计算时不滤波
+
+    TaskHandle_t acq_thread;
+    TaskHandle_t acq_consumer;
+    struct ll_mlx90640_ram_buf *acq_buf;
+    volatile uint8_t acq_busy;
+    uint8_t acq_subpage;
+    struct ll_mlx90640_acq_stat acq_stat;
+};
+
+/**
+ * @brief 刷新率调节器，根据处理和显示一个子帧所用的时间调节刷新率
+ */
+struct ll_mlx90640_gov
+{
+    struct ll_mlx90640 *handle;
+    struct ll_mlx90640_gov_conf conf;
+    TaskHandle_t thread;
+    uint32_t start;      //当前子帧开始处理的tick
+    uint32_t busy;       //评估周期内处理子帧所用的tick数
+    uint32_t last_drops; //上次评估时采集服务的丢帧数
+    uint32_t last_bus;   //上次评估时采集服务读取ram所用的tick数
+    uint8_t up_count;    //连续满足提高条件的次数
+    uint8_t load;        //最近一次评估的负载，百分比
+    uint8_t bus_load;    //最近一次评估的i2c占用，百分比
 };
 
 int ll_mlx90640_init(struct ll_mlx90640 *handle,
                      struct ll_i2c_bus *i2c_bus,
                      enum ll_mlx90640_rate rate);
 int ll_mlx90640_config(struct ll_mlx90640 *handle, enum ll_mlx90640_rate rate);
+int ll_mlx90640_set_mode(struct ll_mlx90640 *handle, const struct ll_mlx90640_mode *mode);
 int ll_mlx90640_read_raw_data(struct ll_mlx90640 *handle, struct ll_mlx90640_ram_buf *data);
 int ll_mlx90640_get_params(struct ll_mlx90640 *handle,
                            struct ll_mlx90640_ee_buf *buf,
                            struct ll_mlx90640_fixed_params *params);
+int ll_mlx90640_load_params(struct ll_mlx90640 *handle,
+                            struct ll_flash *flash,
+                            struct ll_mlx90640_fixed_params *params);
+int ll_mlx90640_save_params(struct ll_mlx90640 *handle,
+                            struct ll_flash *flash,
+                            struct ll_mlx90640_fixed_params *params);
 int ll_mlx90640_calculate_temp(struct ll_mlx90640 *handle,
                                struct ll_mlx90640_fixed_params *params,
-                               struct ll_mlx90640_ram_buf *buf);
+                               struct ll_mlx90640_ram_buf *buf,
+                               struct ll_mlx90640_ir_data *data);
+enum ll_mlx90640_pattern ll_mlx90640_get_pattern(const struct ll_mlx90640_ram_buf *buf);
+int ll_mlx90640_calculate_subpage(struct ll_mlx90640 *handle,
+                                  struct ll_mlx90640_fixed_params *params,
+                                  struct ll_mlx90640_ram_buf *buf,
+                                  int subpage,
+                                  struct ll_mlx90640_ir_data *data);
+int ll_mlx90640_calculate_palette(struct ll_mlx90640 *handle,
+                                  struct ll_mlx90640_fixed_params *params,
+                                  struct ll_mlx90640_ram_buf *buf,
+                                  int subpage,
+                                  float t_min,
+                                  float t_max,
+                                  struct ll_mlx90640_palette_data *data);
+void ll_mlx90640_set_emissivity(struct ll_mlx90640 *handle, float emissivity);
+void ll_mlx90640_coef_cache_init(struct ll_mlx90640_coef_cache *cache,
+                                 float ta_threshold,
+                                 float vdd_threshold,
+                                 uint8_t slice_rows);
+void ll_mlx90640_set_coef_cache(struct ll_mlx90640 *handle, struct ll_mlx90640_coef_cache *cache);
+void ll_mlx90640_filter_init(struct ll_mlx90640_filter *filter, uint8_t k_min, float noise, float motion);
+void ll_mlx90640_set_filter(struct ll_mlx90640 *handle, struct ll_mlx90640_filter *filter);
+void ll_mlx90640_stats_init(struct ll_mlx90640_stats *stats,
+                            struct ll_mlx90640_fixed_params *params,
+                            const uint32_t *roi,
+                            float hist_min,
+                            float hist_max);
+void ll_mlx90640_add_stats(struct ll_mlx90640 *handle, struct ll_mlx90640_stats *stats);
+void ll_mlx90640_remove_stats(struct ll_mlx90640 *handle, struct ll_mlx90640_stats *stats);
+void ll_mlx90640_set_lazy(struct ll_mlx90640 *handle, const uint32_t *mask);
+int ll_mlx90640_acq_start(struct ll_mlx90640 *handle, struct ll_mlx90640_ram_buf *buf, int priority);
+int ll_mlx90640_acq_wait(struct ll_mlx90640 *handle, uint32_t timeout);
+void ll_mlx90640_acq_release(struct ll_mlx90640 *handle);
+void ll_mlx90640_acq_get_stat(struct ll_mlx90640 *handle, struct ll_mlx90640_acq_stat *stat);
+int ll_mlx90640_gov_start(struct ll_mlx90640_gov *gov,
+                          struct ll_mlx90640 *handle,
+                          const struct ll_mlx90640_gov_conf *conf,
+                          int priority);
+void ll_mlx90640_gov_begin(struct ll_mlx90640_gov *gov);
+void ll_mlx90640_gov_end(struct ll_mlx90640_gov *gov);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,93 @@
+/**
+ * @file ll_mlx90640_roi.h
+ * @author salalei (1028609078@qq.com)
+ * @brief mlx90640的感兴趣区域测量
+ * @version 0.1
+ * @date 2022-03-20
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+#ifndef __LL_MLX90640_ROI_H__
+#define __LL_MLX90640_ROI_H__
+
+#include "ll_mlx90640.h"
+
+#ifndef LL_MLX90640_ROI_MAX
+#define LL_MLX90640_ROI_MAX 4 //每组最多的区域个数
+#endif
+
+/**
+ * @brief 区域的测量结果
+ */
+struct ll_mlx90640_roi_result
+{
+    ll_mlx90640_temp_t spot; //区域中心像素的温度
+    ll_mlx90640_temp_t mean;
+    ll_mlx90640_temp_t max;
+    uint16_t argmax; //最大值的像素序号
+    uint16_t count;  //区域内的像素个数
+    uint16_t area;   //超过门限的像素个数
+    uint16_t cx;     //超过门限部分以(温度 - 门限)加权的质心列坐标，Q8，没有超过门限的像素时为最大值所在的列
+    uint16_t cy;     //质心行坐标，Q8
+};
+
+/**
+ * @brief 区域内一个子界面的累加结果
+ */
+struct ll_mlx90640_roi_part
+{
+    ll_mlx90640_temp_t max;
+    uint16_t argmax;
+    uint16_t count;
+    uint16_t area;
+#ifdef LL_MLX90640_USING_FIXED_POINT
+    int32_t sum;
+    int32_t w;  //超过门限部分的权重之和，Q6
+    int32_t wx; //权重乘以列坐标之和
+    int32_t wy; //权重乘以行坐标之和
+#else
+    float sum;
+    float w;
+    float wx;
+    float wy;
+#endif
+};
+
+struct ll_mlx90640_roi
+{
+    uint8_t x;                    //外接矩形左上角的列
+    uint8_t y;                    //外接矩形左上角的行
+    uint8_t w;                    //外接矩形的宽
+    uint8_t h;                    //外接矩形的高
+    const uint32_t *mask;         //为NULL时为整个矩形，否则只包含掩码中的像素，每行一个字，bit n对应第n列
+    ll_mlx90640_temp_t threshold; //面积和质心的温度门限
+    uint8_t touch[2];             //隔行、棋盘模式下区域包含的子界面，bit0、bit1分别对应子界面0、1
+    struct ll_mlx90640_roi_part part[2];
+    struct ll_mlx90640_roi_result result;
+};
+
+/**
+ * @brief 一组区域，每个子界面只更新包含该子界面像素的区域
+ */
+struct ll_mlx90640_roi_set
+{
+    uint8_t numb;
+    struct ll_mlx90640_roi roi[LL_MLX90640_ROI_MAX];
+};
+
+void ll_mlx90640_roi_init(struct ll_mlx90640_roi_set *set);
+int ll_mlx90640_roi_add_rect(struct ll_mlx90640_roi_set *set,
+                             uint8_t x,
+                             uint8_t y,
+                             uint8_t w,
+                             uint8_t h,
+                             float threshold);
+int ll_mlx90640_roi_add_mask(struct ll_mlx90640_roi_set *set, const uint32_t *mask, float threshold);
+void ll_mlx90640_roi_update(struct ll_mlx90640_roi_set *set,
+                            const struct ll_mlx90640_ir_data *data,
+                            int subpage,
+                            enum ll_mlx90640_pattern pattern);
+void ll_mlx90640_roi_get_mask(const struct ll_mlx90640_roi_set *set, uint32_t *mask);
+
+#endif
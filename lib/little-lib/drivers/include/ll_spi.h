@@ -38,6 +38,10 @@ extern "C" {
 #define __LL_SPI_HARD_CS 1
 #define __LL_SPI_NO_CS   2
 
+#ifndef LL_SPI_POLL_THRESHOLD
+#define LL_SPI_POLL_THRESHOLD 8 //不超过该字节数的发送直接轮询完成，不经过dma和中断
+#endif
+
 struct ll_spi_dev;
 struct ll_spi_bus;
 typedef struct QueueDefinition *QueueHandle_t;
@@ -51,6 +55,7 @@ struct ll_spi_trans
     void *buf;
     size_t size;
     uint16_t dir : 1; //传输方向
+    uint16_t cmd : 1; //设备有dc_pin时，为1则传输期间dc_pin为低电平(命令)，否则为高电平(数据)
 };
 
 struct ll_spi_msg
@@ -59,9 +64,11 @@ struct ll_spi_msg
     struct ll_spi_trans *trans;
     size_t size;
     struct ll_spi_dev *dev;
-    void (*complete)(int res);
+    void (*complete)(void *priv, int res);
+    void *priv; //complete的入参
     TaskHandle_t thread;
     int result;
+    uint16_t poll_numb; //本次传输中轮询完成的传输个数
 };
 
 struct ll_spi_conf
@@ -83,6 +90,7 @@ struct ll_spi_dev
     struct ll_spi_conf conf;
     struct ll_pin *cs_pin; //软件片选控制的引脚
     uint32_t cs_index;     //硬件片选控制的索引
+    struct ll_pin *dc_pin; //命令/数据选择引脚，由每次传输的cmd决定电平，为NULL时不控制
 };
 
 struct ll_spi_ops
@@ -91,6 +99,17 @@ struct ll_spi_ops
     ssize_t (*matser_recv)(struct ll_spi_bus *spi, void *buf, size_t size);
     void (*hard_cs_ctrl)(struct ll_spi_bus *spi, bool state);
     int (*config)(struct ll_spi_bus *spi, struct ll_spi_conf *conf);
+    //可选，直接操作寄存器发送并等待发送完成，用于异步总线上的小数据
+    ssize_t (*poll_send)(struct ll_spi_bus *spi, const void *buf, size_t size);
+};
+
+/**
+ * @brief spi总线的传输统计
+ */
+struct ll_spi_stat
+{
+    uint32_t poll_trans; //轮询完成的传输次数
+    uint32_t irq_trans;  //由中断完成的传输次数
 };
 
 struct ll_spi_bus
@@ -105,6 +124,7 @@ struct ll_spi_bus
     uint16_t cs_state : 1;
     uint16_t cs_hard_max_numb;
     uint16_t cs_numb;
+    struct ll_spi_stat stat;
 
     SemaphoreHandle_t lock;
 };
@@ -115,8 +135,10 @@ struct ll_spi_bus
         .size = len, \
         .dev = NULL, \
         .complete = cb, \
+        .priv = NULL, \
         .thread = NULL, \
         .result = 0, \
+        .poll_numb = 0, \
     }
 
 void __ll_spi_irq_handler(struct ll_spi_dev *dev);
@@ -131,7 +153,8 @@ int ll_spi_config(struct ll_spi_dev *dev, struct ll_spi_conf *conf);
 void ll_spi_msg_init(struct ll_spi_msg *msg,
                      struct ll_spi_trans *trans,
                      size_t size,
-                     void (*complete)(int res));
+                     void (*complete)(void *priv, int res),
+                     void *priv);
 int ll_spi_bus_init(struct ll_spi_bus *bus);
 int ll_spi_bus_deinit(struct ll_spi_bus *bus);
 struct ll_spi_dev *ll_spi_dev_find_by_name(struct ll_spi_bus *bus, const char *name);
@@ -17,23 +17,27 @@
 #define LCD_WIDTH    128
 #define LCD_HEIGHT   64
 
+#define LCD_WINDOW_TRANS 5 //设置列、行地址和写显存命令的传输个数
+
 static int lcd_write_cmd(struct lcd_0_96_drv *lcd, uint8_t cmd, const uint8_t *buf, size_t size)
 {
-    int res;
-    struct ll_spi_trans t = {
-        .buf = &cmd,
-        .size = 1,
-        .dir = __LL_SPI_DIR_SEND,
+    struct ll_spi_trans t[2] = {
+        {
+            .buf = &cmd,
+            .size = 1,
+            .dir = __LL_SPI_DIR_SEND,
+            .cmd = 1,
+        },
+        {
+            .buf = (uint8_t *)buf,
+            .size = size,
+            .dir = __LL_SPI_DIR_SEND,
+        },
     };
-    struct ll_spi_msg msg = LL_SPI_MSG_INIT(&t, 1, NULL);
+    struct ll_spi_msg msg = LL_SPI_MSG_INIT(t, buf ? 2 : 1, NULL);
 
-    ll_pin_low(lcd->dc_pin);
-    res = ll_spi_sync(&lcd->dev, &msg);
-    ll_pin_high(lcd->dc_pin);
-    if (res || !buf)
-        return res;
-    t.buf = (uint8_t *)buf;
-    t.size = size;
+    if (lcd->busy)
+        return -EBUSY;
     return ll_spi_sync(&lcd->dev, &msg);
 }
 
@@ -96,47 +100,135 @@ static int init(struct ll_disp_drv *disp)
     return 0;
 }
 
-static int lcd_set_addr(struct lcd_0_96_drv *lcd, const struct ll_disp_rect *rect)
+/**
+ * @brief 生成设置窗口并开始写显存的传输，共LCD_WINDOW_TRANS个
+ *
+ * @param lcd 指向lcd
+ * @param rect 指向窗口
+ * @param addr 用于保存列、行的起止地址，传输完成前要保持有效
+ * @param t 用于保存传输
+ */
+static void lcd_window_trans(struct lcd_0_96_drv *lcd,
+                             const struct ll_disp_rect *rect,
+                             uint8_t *addr,
+                             struct ll_spi_trans *t)
 {
-    uint8_t buf[2];
+    static const uint8_t cmd[3] = {0x15, 0x75, 0x5c};
+    int i;
 
     if (lcd->parent.dir <= LL_DISP_DIR_VERTICAL)
     {
-        buf[0] = rect->y1 + LCD_Y_OFFSET;
-        buf[1] = rect->y2 + LCD_Y_OFFSET;
+        addr[0] = rect->y1 + LCD_Y_OFFSET;
+        addr[1] = rect->y2 + LCD_Y_OFFSET;
+        addr[2] = rect->x1;
+        addr[3] = rect->x2;
     }
     else
     {
-        buf[0] = rect->x1 + LCD_Y_OFFSET;
-        buf[1] = rect->x2 + LCD_Y_OFFSET;
+        addr[0] = rect->x1 + LCD_Y_OFFSET;
+        addr[1] = rect->x2 + LCD_Y_OFFSET;
+        addr[2] = rect->y1;
+        addr[3] = rect->y2;
     }
-    if (lcd_write_cmd(lcd, 0x15, buf, 2))
-        return -EIO;
-
-    if (lcd->parent.dir <= LL_DISP_DIR_VERTICAL)
+    for (i = 0; i < 3; i++)
     {
-        buf[0] = rect->x1;
-        buf[1] = rect->x2;
+        t[i * 2].buf = (uint8_t *)&cmd[i];
+        t[i * 2].size = 1;
+        t[i * 2].dir = __LL_SPI_DIR_SEND;
+        t[i * 2].cmd = 1;
     }
-    else
+    for (i = 0; i < 2; i++)
     {
-        buf[0] = rect->y1;
-        buf[1] = rect->y2;
+        t[i * 2 + 1].buf = &addr[i * 2];
+        t[i * 2 + 1].size = 2;
+        t[i * 2 + 1].dir = __LL_SPI_DIR_SEND;
+        t[i * 2 + 1].cmd = 0;
     }
-    if (lcd_write_cmd(lcd, 0x75, buf, 2))
-        return -EIO;
+}
 
-    return 0;
+/**
+ * @brief 计算无阻塞单色填充下一段发送的数据
+ */
+static void lcd_pattern_next(struct lcd_0_96_drv *lcd, struct ll_spi_trans *t)
+{
+    t->buf = lcd->pattern;
+    t->size = LL_MIN(lcd->remain, sizeof(lcd->pattern));
+    t->dir = __LL_SPI_DIR_SEND;
+    t->cmd = 0;
+    lcd->remain -= t->size;
+}
+
+static void async_complete(void *priv, int res)
+{
+    struct lcd_0_96_drv *lcd = priv;
+
+    if (!res && lcd->remain)
+    {
+        //完成回调时当前消息还在队列中，两条消息轮流使用
+        lcd->index ^= 1;
+        lcd_pattern_next(lcd, &lcd->trans[LCD_WINDOW_TRANS]);
+        ll_spi_msg_init(&lcd->msg[lcd->index], &lcd->trans[LCD_WINDOW_TRANS], 1, async_complete, lcd);
+        res = ll_spi_async(&lcd->dev, &lcd->msg[lcd->index]);
+        if (!res)
+            return;
+    }
+    lcd->busy = 0;
+    __ll_disp_fill_complete(&lcd->parent, res);
+}
+
+/**
+ * @brief 开始无阻塞填充，设置窗口和第一段数据作为一条消息发送，完成后通过__ll_disp_fill_complete通知上层
+ *
+ * @param lcd 指向lcd
+ * @param rect 指向填充区域
+ * @param data 要发送的数据，为NULL时重复发送pattern
+ * @param size 数据的字节数
+ * @return int 成功返回0，失败返回一个负数
+ */
+static int lcd_async_start(struct lcd_0_96_drv *lcd, const struct ll_disp_rect *rect, const void *data, size_t size)
+{
+    struct ll_spi_trans *t = &lcd->trans[LCD_WINDOW_TRANS];
+    int res;
+
+    lcd->busy = 1;
+    lcd_window_trans(lcd, rect, lcd->addr, lcd->trans);
+    lcd->remain = size;
+    if (data)
+    {
+        t->buf = (uint8_t *)data;
+        t->size = size;
+        t->dir = __LL_SPI_DIR_SEND;
+        t->cmd = 0;
+        lcd->remain = 0;
+    }
+    else
+        lcd_pattern_next(lcd, t);
+    lcd->index = 0;
+    ll_spi_msg_init(&lcd->msg[0], lcd->trans, LCD_WINDOW_TRANS + 1, async_complete, lcd);
+    res = ll_spi_async(&lcd->dev, &lcd->msg[0]);
+    if (res)
+        lcd->busy = 0;
+    return res;
 }
 
 static int fill(struct ll_disp_drv *disp, const struct ll_disp_rect *rect, const void *color)
 {
     struct lcd_0_96_drv *lcd = (struct lcd_0_96_drv *)disp;
     size_t size = (rect->x2 - rect->x1 + 1) * (rect->y2 - rect->y1 + 1) * 2;
+    struct ll_spi_trans t[LCD_WINDOW_TRANS + 1];
+    struct ll_spi_msg msg = LL_SPI_MSG_INIT(t, LCD_WINDOW_TRANS + 1, NULL);
+    uint8_t addr[4];
 
-    lcd_set_addr(lcd, rect);
-    lcd_write_cmd(lcd, 0x5c, (const uint8_t *)color, size);
-    return 0;
+    if (lcd->busy)
+        return -EBUSY;
+    if (disp->parent.init_mode & LL_DRV_MODE_NONBLOCK_WRITE)
+        return lcd_async_start(lcd, rect, color, size);
+    lcd_window_trans(lcd, rect, addr, t);
+    t[LCD_WINDOW_TRANS].buf = (uint8_t *)color;
+    t[LCD_WINDOW_TRANS].size = size;
+    t[LCD_WINDOW_TRANS].dir = __LL_SPI_DIR_SEND;
+    t[LCD_WINDOW_TRANS].cmd = 0;
+    return ll_spi_sync(&lcd->dev, &msg);
 }
 
 static int color_fill(struct ll_disp_drv *disp, const struct ll_disp_rect *rect, const void *color)
@@ -144,10 +236,25 @@ static int color_fill(struct ll_disp_drv *disp, const struct ll_disp_rect *rect,
     int res;
     struct lcd_0_96_drv *lcd = (struct lcd_0_96_drv *)disp;
     struct ll_spi_conf conf = lcd->dev.conf;
+    struct ll_spi_trans t[LCD_WINDOW_TRANS];
+    struct ll_spi_msg msg = LL_SPI_MSG_INIT(t, LCD_WINDOW_TRANS, NULL);
+    uint8_t addr[4];
 
-    if (lcd_set_addr(lcd, rect))
-        return -EIO;
-    if (lcd_write_cmd(lcd, 0x5c, NULL, 0))
+    if (lcd->busy)
+        return -EBUSY;
+    //无阻塞模式下不能在中断里切换spi配置，改为重复发送一段按8位帧排列的颜色
+    if (disp->parent.init_mode & LL_DRV_MODE_NONBLOCK_WRITE)
+    {
+        uint16_t c = *(const uint16_t *)color;
+        int i;
+
+        c = c >> 8 | c << 8;
+        for (i = 0; i < LL_0_96_LCD_PATTERN_SIZE; i++)
+            lcd->pattern[i] = c;
+        return lcd_async_start(lcd, rect, NULL, (rect->x2 - rect->x1 + 1) * (rect->y2 - rect->y1 + 1) * 2);
+    }
+    lcd_window_trans(lcd, rect, addr, t);
+    if (ll_spi_sync(&lcd->dev, &msg))
         return -EIO;
     conf.send_addr_not_inc = 1;
     conf.frame_bits = __LL_SPI_FRAME_16BIT;
@@ -224,6 +331,9 @@ int ll_0_96_lcd_init(struct lcd_0_96_drv *lcd_drv,
     lcd_drv->dev.conf.proto = __LL_SPI_PROTO_STD;
     lcd_drv->dev.conf.send_addr_not_inc = 0;
     lcd_drv->dev.spi = lcd_spi;
+    lcd_drv->dev.dc_pin = lcd_drv->dc_pin;
+    lcd_drv->index = 0;
+    lcd_drv->busy = 0;
     if (ll_spi_dev_register(&lcd_drv->dev, name, NULL, __LL_DRV_MODE_WRITE))
         return -ENOSYS;
     lcd_drv->parent.framebuf = NULL;
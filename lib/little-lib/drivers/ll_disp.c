@@ -14,17 +14,32 @@
 #include "FreeRTOS.h"
 #include "task.h"
 
+//条带刷新专用的通知，不与spi和串口同步传输使用的通知1共用
+#define DISP_NOTIFY_INDEX 2
+#if configTASK_NOTIFICATION_ARRAY_ENTRIES <= DISP_NOTIFY_INDEX
+#error "configTASK_NOTIFICATION_ARRAY_ENTRIES must be greater than DISP_NOTIFY_INDEX"
+#endif
+
 /**
  * @brief 底层驱动在数据填充完成后调用该函数，以通知上层填充完成
  *
  * @param disp 指向显示设备的指针
+ * @param res 填充的结果，成功为0，失败为负数
  */
-void __ll_disp_fill_complete(struct ll_disp_drv *disp)
+void __ll_disp_fill_complete(struct ll_disp_drv *disp, int res)
 {
     void (*cb)(void *);
     void *priv;
 
     LL_ASSERT(disp && disp->parent.drv_mode & __LL_DRV_MODE_ASYNC_WRITE);
+    disp->fill_result = res;
+    if (disp->thread)
+    {
+        BaseType_t woken = 0;
+        vTaskNotifyGiveIndexedFromISR(disp->thread, DISP_NOTIFY_INDEX, &woken);
+        portYIELD_FROM_ISR(woken);
+        return;
+    }
     do
     {
         cb = disp->fill_cb;
@@ -56,6 +71,7 @@ int __ll_disp_register(struct ll_disp_drv *disp,
     disp->dir = LL_DISP_DIR_HORIZONTAL;
     disp->fill_cb = NULL;
     disp->priv = NULL;
+    disp->thread = NULL;
 
     __ll_drv_register(&disp->parent);
 
@@ -90,6 +106,7 @@ int ll_disp_init(struct ll_disp_drv *disp, int mode)
             return res;
         }
     }
+    disp->parent.init_mode = mode;
     disp->parent.init = 1;
 
     return 0;
@@ -121,6 +138,9 @@ int ll_disp_deinit(struct ll_disp_drv *disp)
 /**
  * @brief 填充指定区域的画面
  *
+ * 以LL_DRV_MODE_NONBLOCK_WRITE初始化时启动填充后立即返回，完成后调用fill_cb，
+ * 在此之前color指向的数据要保持有效，新的填充请求返回-EBUSY
+ *
  * @param disp 指向显示设备的指针
  * @param rect 指向填充区域的指针
  * @param color 指向填充颜色的指针
@@ -139,6 +159,9 @@ int ll_disp_fill(struct ll_disp_drv *disp, const struct ll_disp_rect *rect, void
 /**
  * @brief 将指定区域填充成单色
  *
+ * 以LL_DRV_MODE_NONBLOCK_WRITE初始化时启动填充后立即返回，完成后调用fill_cb，
+ * color在返回后即可释放
+ *
  * @param disp 指向显示设备的指针
  * @param rect 指向填充区域的指针
  * @param color 指向填充颜色的指针
@@ -154,6 +177,109 @@ int ll_disp_fill_color(struct ll_disp_drv *disp, const struct ll_disp_rect *rect
     return disp->ops->color_fill(disp, rect, color);
 }
 
+/**
+ * @brief 等待上一次异步填充完成
+ *
+ * @param disp 指向显示设备的指针
+ * @return int 填充的结果
+ */
+static int disp_wait_fill(struct ll_disp_drv *disp)
+{
+    ulTaskNotifyTakeIndexed(DISP_NOTIFY_INDEX, pdTRUE, portMAX_DELAY);
+    return disp->fill_result;
+}
+
+/**
+ * @brief 分条带刷新指定区域，用于没有足够内存保存整个画面的显示设备
+ *
+ * 每次由render把若干整行的像素按行依次写入buf，再填充到屏幕上，
+ * 直到整个区域刷新完成；
+ * 以LL_DRV_MODE_NONBLOCK_WRITE初始化时buf分成两半轮流使用，
+ * 在发送一个条带的同时生成下一个条带，同一时间只有一个填充在进行，
+ * 期间完成通知不会调用fill_cb，函数返回时所有条带都已发送完成
+ *
+ * @param disp 指向显示设备的指针
+ * @param rect 指向刷新区域的指针
+ * @param buf 条带缓存区，至少能保存区域内的一行像素，能保存两行以上时才能同时生成和发送
+ * @param size 条带缓存区的字节数
+ * @param render 生成一个条带的像素，返回0表示成功，返回负数时停止刷新并返回该值
+ * @param priv render的入参
+ * @return int 成功返回0，失败返回负数
+ */
+int ll_disp_render(struct ll_disp_drv *disp,
+                   const struct ll_disp_rect *rect,
+                   void *buf,
+                   size_t size,
+                   int (*render)(void *priv, const struct ll_disp_rect *band, void *buf),
+                   void *priv)
+{
+    static const uint8_t color_bits[LL_DISP_COLOR_LIMIT] = {1, 8, 16, 16, 16, 24, 24, 32};
+    struct ll_disp_rect band;
+    size_t line_size;
+    uint16_t lines;
+    uint8_t numb, index = 0;
+    bool async, pending = false;
+    int res = 0;
+
+    LL_ASSERT(disp &&
+              rect &&
+              rect->x1 <= rect->x2 && rect->y1 <= rect->y2 &&
+              rect->x2 < disp->width && rect->y2 < disp->height &&
+              buf && render && !disp->framebuf);
+    line_size = ((rect->x2 - rect->x1 + 1) * color_bits[disp->color] + 7) / 8;
+    if (size < line_size)
+        return -EINVAL;
+    async = disp->parent.init_mode & LL_DRV_MODE_NONBLOCK_WRITE;
+    numb = async && size >= line_size * 2 ? 2 : 1;
+    lines = LL_MIN(size / numb / line_size, rect->y2 - rect->y1 + 1);
+    if (async)
+    {
+        //清除之前残留的通知，避免还在发送的缓存被当作已完成而重用
+        ulTaskNotifyTakeIndexed(DISP_NOTIFY_INDEX, pdTRUE, 0);
+        disp->thread = xTaskGetCurrentTaskHandle();
+    }
+    band.x1 = rect->x1;
+    band.x2 = rect->x2;
+    for (band.y1 = rect->y1; band.y1 <= rect->y2; band.y1 = band.y2 + 1)
+    {
+        uint8_t *p = (uint8_t *)buf + index * lines * line_size;
+
+        band.y2 = LL_MIN(band.y1 + lines - 1, rect->y2);
+        //只有一块缓存时要等发送完成才能生成下一个条带
+        if (pending && numb == 1)
+        {
+            pending = false;
+            res = disp_wait_fill(disp);
+            if (res)
+                break;
+        }
+        res = render(priv, &band, p);
+        if (res)
+            break;
+        if (pending)
+        {
+            pending = false;
+            res = disp_wait_fill(disp);
+            if (res)
+                break;
+        }
+        res = disp->ops->fill(disp, &band, p);
+        if (res)
+            break;
+        pending = async;
+        index = (index + 1) % numb;
+    }
+    if (pending)
+    {
+        int temp = disp_wait_fill(disp);
+        if (!res)
+            res = temp;
+    }
+    disp->thread = NULL;
+
+    return res;
+}
+
 /**
  * @brief 画一个点
  *
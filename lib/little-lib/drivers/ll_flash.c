@@ -0,0 +1,86 @@
+/**
+ * @file ll_flash.c
+ * @author salalei (1028609078@qq.com)
+ * @brief 片上flash驱动框架
+ * @version 0.1
+ * @date 2022-03-05
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+#include "ll_flash.h"
+
+/**
+ * @brief 注册一块flash区域(供底层驱动使用)
+ *
+ * @param flash 指向ll_flash
+ * @param name flash区域的名字
+ * @param priv 指向驱动的私人数据
+ * @return int 返回0
+ */
+int __ll_flash_register(struct ll_flash *flash,
+                        const char *name,
+                        void *priv)
+{
+    LL_ASSERT(flash && flash->ops && flash->ops->read && flash->ops->write && flash->ops->erase);
+    LL_ASSERT(flash->erase_size && flash->write_size && !(flash->size % flash->erase_size));
+    __ll_drv_init(&flash->parent, name, priv, __LL_DRV_MODE_READ | __LL_DRV_MODE_WRITE);
+
+    __ll_drv_register(&flash->parent);
+    return 0;
+}
+
+/**
+ * @brief 读取flash
+ *
+ * @param flash 指向ll_flash
+ * @param offset 相对于区域起始地址的偏移
+ * @param buf 用于保存读取的数据
+ * @param size 读取的字节数
+ * @return int 成功返回0，失败返回一个负数
+ */
+int ll_flash_read(struct ll_flash *flash, uint32_t offset, void *buf, size_t size)
+{
+    LL_ASSERT(flash && buf);
+    if (offset > flash->size || size > flash->size - offset)
+        return -EINVAL;
+    return flash->ops->read(flash, offset, buf, size);
+}
+
+/**
+ * @brief 写入flash，写入前需要先擦除
+ *
+ * @param flash 指向ll_flash
+ * @param offset 相对于区域起始地址的偏移，需要按write_size对齐
+ * @param buf 指向需要写入的数据
+ * @param size 写入的字节数，不足write_size的部分用0xff补齐
+ * @return int 成功返回0，失败返回一个负数
+ */
+int ll_flash_write(struct ll_flash *flash, uint32_t offset, const void *buf, size_t size)
+{
+    LL_ASSERT(flash && buf);
+    if (offset % flash->write_size)
+        return -EINVAL;
+    if (offset > flash->size || size > flash->size - offset)
+        return -EINVAL;
+    return flash->ops->write(flash, offset, buf, size);
+}
+
+/**
+ * @brief 擦除flash
+ *
+ * @param flash 指向ll_flash
+ * @param offset 相对于区域起始地址的偏移，需要按erase_size对齐
+ * @param size 擦除的字节数，会向上对齐到erase_size
+ * @return int 成功返回0，失败返回一个负数
+ */
+int ll_flash_erase(struct ll_flash *flash, uint32_t offset, size_t size)
+{
+    LL_ASSERT(flash);
+    if (offset % flash->erase_size)
+        return -EINVAL;
+    size = (size + flash->erase_size - 1) / flash->erase_size * flash->erase_size;
+    if (offset > flash->size || size > flash->size - offset)
+        return -EINVAL;
+    return flash->ops->erase(flash, offset, size);
+}
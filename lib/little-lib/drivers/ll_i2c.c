@@ -28,7 +28,7 @@ int __ll_i2c_bus_register(struct ll_i2c_bus *i2c,
                           void *priv,
                           int drv_mode)
 {
-    LL_ASSERT(i2c && i2c->ops && i2c->ops->master_xfer);
+    LL_ASSERT(i2c && i2c->ops && i2c->ops->master_xfer && i2c->max_speed_hz);
     __ll_drv_init(&i2c->parent, name, priv, drv_mode);
     ll_list_head_init(&i2c->dev_head);
     i2c->lock = NULL;
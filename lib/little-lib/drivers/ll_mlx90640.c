@@ -10,11 +10,16 @@
  */
 #include "ll_mlx90640.h"
 #include "ll_assert.h"
+#include "ll_flash.h"
 #include "ll_log.h"
 
 #include "FreeRTOS.h"
 #include "task.h"
 
+#include <float.h>
+#include <math.h>
+#include <string.h>
+
 #define DEVICE_ADDRESS 0x33
 
 #define STATUS_REG                 0x8000
@@ -40,7 +45,26 @@
 #define I2C_THRESHOLD_HOLD_LEVELS_BIT (1 << 1)
 #define FM_DIS_BIT                    (1 << 0)
 
+#define EE_ADDR    0x2400
+#define EE_ID_ADDR (EE_ADDR + 0x07) //器件ID，共3个字
+
 #define RAM_ADDR 0x0400
+#define AUX_ADDR (RAM_ADDR + 0x0300)
+//每个子界面的辅助数据只需读取Vbe(Vptat)到Vdd这一段
+#define AUX_BURST_SIZE 11
+
+#ifndef LL_MLX90640_ACQ_STACK_SIZE
+#define LL_MLX90640_ACQ_STACK_SIZE 256
+#endif
+
+#ifndef LL_MLX90640_GOV_STACK_SIZE
+#define LL_MLX90640_GOV_STACK_SIZE 256
+#endif
+
+//传感器最高支持1MHz(快速+模式)，总线不支持时由i2c框架限制到总线的最高速率
+#ifndef LL_MLX90640_I2C_SPEED_HZ
+#define LL_MLX90640_I2C_SPEED_HZ 1000000
+#endif
 
 static int read_16bits(struct ll_mlx90640 *handle, uint16_t regaddr, uint16_t *buf, size_t size)
 {
@@ -107,6 +131,44 @@ static int write_16bit(struct ll_mlx90640 *handle, uint16_t regaddr, uint16_t re
     } \
     while (0);
 
+/**
+ * @brief 根据测量模式得到CTRL_REG的值
+ *
+ * @param mode 指向测量模式
+ * @return uint16_t CTRL_REG的值
+ */
+static uint16_t mode_to_ctrl(const struct ll_mlx90640_mode *mode)
+{
+    uint16_t regdata = EN_SUBPAGE_MODE_BIT;
+
+    regdata |= mode->resolution << RESOLUTION_CTRL_POS;
+    regdata |= mode->rate << RATE_CTRL_POS;
+    if (mode->pattern == LL_MLX90640_PATTERN_CHESS)
+        regdata |= READING_PATTERN_BIT;
+    if (mode->subpage_repeat)
+        regdata |= EN_SUBPAGE_REPEAT_BIT | (mode->select_subpage << SELECT_SUBPAGE_POS);
+    if (mode->data_hold)
+        regdata |= EN_DATA_HOLD_BIT;
+    return regdata;
+}
+
+/**
+ * @brief 写入测量模式，切换时正在进行的测量可能混用新旧配置，因此丢弃下一个子界面
+ *
+ * @param handle 指向ll_mlx90640
+ * @param mode 指向测量模式
+ * @return int 成功返回0，失败返回一个负数
+ */
+static int mode_write(struct ll_mlx90640 *handle, const struct ll_mlx90640_mode *mode)
+{
+    int res;
+
+    WRITE_16BIT(handle, CTRL_REG, mode_to_ctrl(mode));
+    handle->mode = *mode;
+    handle->mode_skip = 1;
+    return 0;
+}
+
 int ll_mlx90640_init(struct ll_mlx90640 *handle,
                      struct ll_i2c_bus *i2c_bus,
                      enum ll_mlx90640_rate rate)
@@ -114,28 +176,140 @@ int ll_mlx90640_init(struct ll_mlx90640 *handle,
     int res;
     uint16_t regdata;
     TickType_t pov_tick = 0;
+    struct ll_mlx90640_mode mode = {
+        .rate = rate,
+        .resolution = LL_MLX90640_RESOLUTION_18,
+        .pattern = LL_MLX90640_PATTERN_CHESS,
+    };
 
     LL_ASSERT(handle && i2c_bus && rate < LL_MLX90640_RATE_LIMIT);
     handle->dev.addr = DEVICE_ADDRESS;
     handle->dev.i2c = i2c_bus;
+    handle->dev.max_speed_hz = 400000;
+    handle->emissivity = 1;
+    handle->mode_pending = 0;
+    handle->coef_cache = NULL;
+    handle->filter = NULL;
+    ll_list_head_init(&handle->stats_head);
+    handle->lazy = 0;
+    handle->acq_thread = NULL;
+    memset(&handle->acq_stat, 0, sizeof(struct ll_mlx90640_acq_stat));
     res = ll_i2c_dev_register(&handle->dev, "mlx90640", NULL, __LL_DRV_MODE_READ | __LL_DRV_MODE_WRITE);
     if (res)
         return res;
 
     //上电40ms开始操作
     vTaskDelayUntil(&pov_tick, 40);
-    regdata = READING_PATTERN_BIT | (0x2 << RESOLUTION_CTRL_POS) | (rate << RATE_CTRL_POS) | EN_SUBPAGE_MODE_BIT;
-    WRITE_16BIT(handle, CTRL_REG, regdata);
+    res = mode_write(handle, &mode);
+    if (res)
+        return res;
+    handle->mode_skip = 0;
     WRITE_16BIT(handle, STATUS_REG, 0);
 
+    //先以400kHz打开传感器的快速+模式，再提高设备速率
+    if (LL_MLX90640_I2C_SPEED_HZ > 400000)
+    {
+        READ_16BITS(handle, I2C_CONFIG_REG, &regdata, 1);
+        if (regdata & FM_DIS_BIT)
+            WRITE_16BIT(handle, I2C_CONFIG_REG, regdata & ~FM_DIS_BIT);
+        handle->dev.max_speed_hz = LL_MLX90640_I2C_SPEED_HZ;
+    }
+
     return 0;
 }
 
+/**
+ * @brief 只修改刷新率，其余测量模式保持不变
+ *
+ * @param handle 指向ll_mlx90640
+ * @param rate 刷新率
+ * @return int 成功返回0，失败返回一个负数
+ */
 int ll_mlx90640_config(struct ll_mlx90640 *handle, enum ll_mlx90640_rate rate)
+{
+    struct ll_mlx90640_mode mode;
+
+    LL_ASSERT(handle && rate < LL_MLX90640_RATE_LIMIT);
+    mode = handle->mode_pending ? handle->new_mode : handle->mode;
+    mode.rate = rate;
+    return ll_mlx90640_set_mode(handle, &mode);
+}
+
+/**
+ * @brief 设置测量模式，不需要重新读取eeprom
+ *
+ * 采集服务运行时由采集线程在一帧(子界面1)结束后应用，否则立即写入；
+ * 切换时正在测量的子界面会被丢弃，与分辨率和读取模式相关的计算参数随ram数据一起切换
+ *
+ * @param handle 指向ll_mlx90640
+ * @param mode 指向测量模式
+ * @return int 成功返回0，失败返回一个负数
+ */
+int ll_mlx90640_set_mode(struct ll_mlx90640 *handle, const struct ll_mlx90640_mode *mode)
+{
+    uint32_t temp;
+
+    LL_ASSERT(handle && mode);
+    if (mode->rate >= LL_MLX90640_RATE_LIMIT ||
+        mode->resolution >= LL_MLX90640_RESOLUTION_LIMIT ||
+        mode->pattern > LL_MLX90640_PATTERN_CHESS ||
+        mode->select_subpage > 1)
+        return -EINVAL;
+    if (!handle->acq_thread)
+        return mode_write(handle, mode);
+
+    temp = taskENTER_CRITICAL_FROM_ISR();
+    handle->new_mode = *mode;
+    handle->mode_pending = 1;
+    taskEXIT_CRITICAL_FROM_ISR(temp);
+    return 0;
+}
+
+/**
+ * @brief 清除数据就绪标志并读取ram
+ *
+ * 只读取子界面的像素以及计算所需的辅助数据，其余数据保持不变。
+ * 隔行模式下子界面的像素为连续的行，逐行读取；
+ * 棋盘模式下每行都交替分布，分段读取的额外开销大于节省的数据量，因此读取该子界面首尾像素之间的连续区域。
+ * 开启data_hold时读取完成后才允许传感器写入下一个子界面
+ *
+ * @param handle 指向ll_mlx90640
+ * @param buf 指向用于缓存ram数据的缓存区
+ * @param subpage 子界面号，小于0时读取全部ram
+ * @return int 成功返回0，失败返回一个负数
+ */
+static int read_ram(struct ll_mlx90640 *handle, struct ll_mlx90640_ram_buf *buf, int subpage)
 {
     int res;
-    uint16_t regdata = READING_PATTERN_BIT | (0x2 << RESOLUTION_CTRL_POS) | (rate << RATE_CTRL_POS) | EN_SUBPAGE_MODE_BIT;
-    WRITE_16BIT(handle, CTRL_REG, regdata);
+    int i;
+
+    WRITE_16BIT(handle, STATUS_REG, 0);
+    buf->ctrl = mode_to_ctrl(&handle->mode);
+    if (subpage < 0)
+    {
+        READ_16BITS(handle, RAM_ADDR, (uint16_t *)buf, (sizeof(buf->data) + sizeof(buf->params)) >> 1);
+        handle->acq_stat.words += (sizeof(buf->data) + sizeof(buf->params)) >> 1;
+    }
+    else if (handle->mode.pattern == LL_MLX90640_PATTERN_CHESS)
+    {
+        READ_16BITS(handle, RAM_ADDR + subpage, &buf->data[subpage], 768 - 2 * subpage);
+        handle->acq_stat.words += 768 - 2 * subpage;
+    }
+    else
+    {
+        for (i = subpage; i < 24; i += 2)
+            READ_16BITS(handle, RAM_ADDR + (i << 5), &buf->data[i << 5], 32);
+        handle->acq_stat.words += 12 * 32;
+    }
+    if (subpage >= 0)
+    {
+        READ_16BITS(handle, AUX_ADDR, &buf->params[0x00], AUX_BURST_SIZE);
+        READ_16BITS(handle, AUX_ADDR + 0x20, &buf->params[0x20], AUX_BURST_SIZE);
+        handle->acq_stat.words += 2 * AUX_BURST_SIZE;
+    }
+    if (handle->mode.data_hold)
+        WRITE_16BIT(handle, STATUS_REG, EN_OW_BIT);
+
     return 0;
 }
 
@@ -155,13 +329,373 @@ int ll_mlx90640_read_raw_data(struct ll_mlx90640 *handle, struct ll_mlx90640_ram
     READ_16BITS(handle, STATUS_REG, &regdata, 1);
     if (!(regdata & DATA_READY_IN_RAM_BIT))
         return -EAGAIN;
+    if (handle->mode_skip)
+    {
+        handle->mode_skip = 0;
+        WRITE_16BIT(handle, STATUS_REG, handle->mode.data_hold ? EN_OW_BIT : 0);
+        return -EAGAIN;
+    }
 
-    WRITE_16BIT(handle, STATUS_REG, 0);
-    READ_16BITS(handle, RAM_ADDR, (uint16_t *)buf, sizeof(struct ll_mlx90640_ram_buf));
+    return read_ram(handle, buf, -1);
+}
+
+/**
+ * @brief 查询一次数据是否就绪
+ *
+ * @param handle 指向ll_mlx90640
+ * @param status 用于保存STATUS_REG的值
+ * @return true 数据已就绪
+ * @return false 数据未就绪或读取失败
+ */
+static bool acq_poll(struct ll_mlx90640 *handle, uint16_t *status)
+{
+    handle->acq_stat.polls++;
+    if (read_16bits(handle, STATUS_REG, status, 1))
+        return false;
+    return *status & DATA_READY_IN_RAM_BIT;
+}
+
+/**
+ * @brief 采集线程
+ *
+ * 根据当前的刷新率推算下一个子帧的就绪时间，在此之前一直休眠，
+ * 只在就绪时间前后的窗口内逐tick查询STATUS_REG，失步后在一个周期内低频查询以重新同步。
+ * 新的测量模式在一帧结束(子界面1或重复测量的子界面就绪)后写入
+ *
+ * @param param 指向ll_mlx90640
+ */
+static void acq_thread(void *param)
+{
+    struct ll_mlx90640 *handle = (struct ll_mlx90640 *)param;
+    enum ll_mlx90640_rate rate = LL_MLX90640_RATE_LIMIT;
+    bool synced = false;
+    TickType_t wake = xTaskGetTickCount();
+    TickType_t period = 0, window = 0, deadline, interval;
+    int subpage, res;
+    uint16_t status, polls;
+    uint32_t temp;
+    bool ready;
+    struct ll_mlx90640_mode mode;
+
+    while (1)
+    {
+        if (rate != handle->mode.rate)
+        {
+            rate = handle->mode.rate;
+            period = pdMS_TO_TICKS(2000 >> rate);
+            window = period / 8 + 2;
+            synced = false;
+        }
+        if (synced)
+        {
+            vTaskDelayUntil(&wake, period - window);
+            deadline = xTaskGetTickCount() + 2 * window;
+            interval = 1;
+        }
+        else
+        {
+            deadline = xTaskGetTickCount() + period + window;
+            interval = LL_MAX(period / 16, 1);
+        }
+
+        polls = 0;
+        while (1)
+        {
+            polls++;
+            ready = acq_poll(handle, &status);
+            if (ready || (int32_t)(xTaskGetTickCount() - deadline) >= 0)
+                break;
+            vTaskDelay(interval);
+        }
+        handle->acq_stat.last_polls = polls;
+        if (polls > handle->acq_stat.max_polls)
+            handle->acq_stat.max_polls = polls;
+        if (!ready)
+        {
+            handle->acq_stat.timeouts++;
+            synced = false;
+            //data_hold模式下读取失败时传感器可能一直不能写入ram
+            if (handle->mode.data_hold)
+                write_16bit(handle, STATUS_REG, EN_OW_BIT);
+            continue;
+        }
+        wake = xTaskGetTickCount();
+        synced = true;
+        subpage = (status & LAST_MEASURED_SUBPAGE_MASK) >> LAST_MEASURED_SUBPAGE_POS;
+
+        if (handle->acq_busy || handle->mode_skip)
+        {
+            if (!handle->mode_skip)
+                handle->acq_stat.drops++;
+            handle->mode_skip = 0;
+            write_16bit(handle, STATUS_REG, handle->mode.data_hold ? EN_OW_BIT : 0);
+        }
+        else
+        {
+            res = read_ram(handle, handle->acq_buf, subpage);
+            handle->acq_stat.bus_ticks += xTaskGetTickCount() - wake;
+            if (res)
+                handle->acq_stat.drops++;
+            else
+            {
+                handle->acq_subpage = subpage;
+                handle->acq_busy = 1;
+                handle->acq_stat.frames++;
+                xTaskNotifyGiveIndexed(handle->acq_consumer, 0);
+            }
+        }
+
+        if (handle->mode_pending && (subpage == 1 || handle->mode.subpage_repeat))
+        {
+            temp = taskENTER_CRITICAL_FROM_ISR();
+            mode = handle->new_mode;
+            handle->mode_pending = 0;
+            taskEXIT_CRITICAL_FROM_ISR(temp);
+            //写入失败时保留请求，下一帧结束后重试
+            if (mode_write(handle, &mode))
+                handle->mode_pending = 1;
+            else
+                synced = false;
+        }
+    }
+}
+
+/**
+ * @brief 启动采集服务，调用者即为数据的使用者
+ *
+ * @param handle 指向ll_mlx90640
+ * @param buf 指向用于缓存ram数据的缓存区
+ * @param priority 采集线程的优先级
+ * @return int 成功返回0，失败返回一个负数
+ */
+int ll_mlx90640_acq_start(struct ll_mlx90640 *handle, struct ll_mlx90640_ram_buf *buf, int priority)
+{
+    LL_ASSERT(handle && buf && !handle->acq_thread);
+    handle->acq_consumer = xTaskGetCurrentTaskHandle();
+    handle->acq_buf = buf;
+    handle->acq_busy = 0;
+    handle->acq_subpage = 0;
+    memset(&handle->acq_stat, 0, sizeof(struct ll_mlx90640_acq_stat));
+    if (xTaskCreate(acq_thread, "mlx acq", LL_MLX90640_ACQ_STACK_SIZE, handle, priority, &handle->acq_thread) != pdPASS)
+    {
+        handle->acq_thread = NULL;
+        return -ENOMEM;
+    }
+    return 0;
+}
+
+/**
+ * @brief 等待采集服务送来新的子帧，处理完成后需要调用ll_mlx90640_acq_release
+ *
+ * @param handle 指向ll_mlx90640
+ * @param timeout 超时时间
+ * @return int 成功返回子帧号，超时返回-ETIMEDOUT
+ */
+int ll_mlx90640_acq_wait(struct ll_mlx90640 *handle, uint32_t timeout)
+{
+    LL_ASSERT(handle && handle->acq_thread);
+    if (ulTaskNotifyTakeIndexed(0, pdTRUE, timeout) == 0)
+        return -ETIMEDOUT;
+    return handle->acq_subpage;
+}
+
+/**
+ * @brief 释放缓存区，允许采集服务写入下一个子帧
+ *
+ * @param handle 指向ll_mlx90640
+ */
+void ll_mlx90640_acq_release(struct ll_mlx90640 *handle)
+{
+    LL_ASSERT(handle);
+    handle->acq_busy = 0;
+}
+
+/**
+ * @brief 获取采集服务的统计信息
+ *
+ * @param handle 指向ll_mlx90640
+ * @param stat 用于保存统计信息
+ */
+void ll_mlx90640_acq_get_stat(struct ll_mlx90640 *handle, struct ll_mlx90640_acq_stat *stat)
+{
+    uint32_t temp;
+
+    LL_ASSERT(handle && stat);
+    temp = taskENTER_CRITICAL_FROM_ISR();
+    memcpy(stat, &handle->acq_stat, sizeof(struct ll_mlx90640_acq_stat));
+    taskEXIT_CRITICAL_FROM_ISR(temp);
+}
+
+/**
+ * @brief 刷新率调节线程
+ *
+ * 每个评估周期统计处理子帧所用时间占的比例，出现丢帧或负载超过100 - headroom时降低一档刷新率；
+ * 刷新率提高一档后负载约为原来的两倍，连续up_hold次估算的负载加上hysteresis仍不超过上限时才提高一档。
+ * 刷新率改变后的第一个评估周期混有新旧刷新率的数据，不作判断。
+ * 读取ram的时间同样按比例统计为i2c占用，开启auto_pattern时i2c占用过高先切换到隔行模式，
+ * 棋盘模式每个子界面仍需读取几乎整个ram，隔行模式只需一半
+ *
+ * @param param 指向ll_mlx90640_gov
+ */
+static void gov_thread(void *param)
+{
+    struct ll_mlx90640_gov *gov = (struct ll_mlx90640_gov *)param;
+    struct ll_mlx90640 *handle = gov->handle;
+    TickType_t wake = xTaskGetTickCount();
+    TickType_t last = wake, now;
+    uint32_t busy, bus, drops, temp;
+    uint8_t limit = 100 - gov->conf.headroom;
+    struct ll_mlx90640_mode mode;
+    enum ll_mlx90640_rate rate, next;
+    bool settle = true;
+
+    while (1)
+    {
+        vTaskDelayUntil(&wake, pdMS_TO_TICKS(gov->conf.interval));
+        now = xTaskGetTickCount();
+        temp = taskENTER_CRITICAL_FROM_ISR();
+        busy = gov->busy;
+        gov->busy = 0;
+        drops = handle->acq_stat.drops - gov->last_drops;
+        gov->last_drops = handle->acq_stat.drops;
+        bus = handle->acq_stat.bus_ticks - gov->last_bus;
+        gov->last_bus = handle->acq_stat.bus_ticks;
+        taskEXIT_CRITICAL_FROM_ISR(temp);
+        gov->load = (uint8_t)LL_MIN(busy * 100 / (now - last), 100);
+        gov->bus_load = (uint8_t)LL_MIN(bus * 100 / (now - last), 100);
+        last = now;
+        if (settle)
+        {
+            settle = false;
+            continue;
+        }
+
+        mode = handle->mode_pending ? handle->new_mode : handle->mode;
+        if (gov->conf.auto_pattern && gov->bus_load > limit && mode.pattern == LL_MLX90640_PATTERN_CHESS)
+        {
+            mode.pattern = LL_MLX90640_PATTERN_INTERLEAVED;
+            if (ll_mlx90640_set_mode(handle, &mode))
+            {
+                LL_WARN("gov set pattern failed");
+                continue;
+            }
+            LL_INFO("gov pattern chess -> interleaved, bus %u%%", gov->bus_load);
+            gov->up_count = 0;
+            settle = true;
+            continue;
+        }
+
+        rate = mode.rate;
+        next = rate;
+        if ((drops || gov->load > limit || gov->bus_load > limit) && rate > gov->conf.min_rate)
+        {
+            next = (enum ll_mlx90640_rate)(rate - 1);
+            gov->up_count = 0;
+        }
+        else if (rate < gov->conf.max_rate &&
+                 gov->load * 2 + gov->conf.hysteresis <= limit &&
+                 gov->bus_load * 2 + gov->conf.hysteresis <= limit)
+        {
+            if (++gov->up_count >= gov->conf.up_hold)
+            {
+                next = (enum ll_mlx90640_rate)(rate + 1);
+                gov->up_count = 0;
+            }
+        }
+        else
+            gov->up_count = 0;
+        if (next == rate)
+            continue;
+
+        if (ll_mlx90640_config(handle, next))
+        {
+            LL_WARN("gov set rate %d failed", next);
+            continue;
+        }
+        LL_INFO("gov rate %d -> %d, load %u%%, bus %u%%, drops %u", rate, next, gov->load, gov->bus_load, drops);
+        settle = true;
+    }
+}
+
+/**
+ * @brief 启动刷新率调节器，需要在采集服务启动后调用
+ *
+ * 使用者在处理每个子帧前后分别调用ll_mlx90640_gov_begin和ll_mlx90640_gov_end，
+ * 两者之间的时间(包括计算和显示)计入负载
+ *
+ * @param gov 指向ll_mlx90640_gov
+ * @param handle 指向ll_mlx90640
+ * @param conf 指向调节器的配置
+ * @param priority 调节线程的优先级
+ * @return int 成功返回0，失败返回一个负数
+ */
+int ll_mlx90640_gov_start(struct ll_mlx90640_gov *gov,
+                          struct ll_mlx90640 *handle,
+                          const struct ll_mlx90640_gov_conf *conf,
+                          int priority)
+{
+    int res;
+    enum ll_mlx90640_rate rate;
+
+    LL_ASSERT(gov && handle && conf && handle->acq_thread);
+    if (conf->min_rate > conf->max_rate ||
+        conf->max_rate >= LL_MLX90640_RATE_LIMIT ||
+        conf->headroom >= 100 ||
+        !conf->up_hold ||
+        !conf->interval)
+        return -EINVAL;
+    rate = LL_MAX(LL_MIN(handle->mode.rate, conf->max_rate), conf->min_rate);
+    if (rate != handle->mode.rate)
+    {
+        res = ll_mlx90640_config(handle, rate);
+        if (res)
+            return res;
+    }
 
+    gov->handle = handle;
+    gov->conf = *conf;
+    gov->start = xTaskGetTickCount();
+    gov->busy = 0;
+    gov->last_drops = handle->acq_stat.drops;
+    gov->last_bus = handle->acq_stat.bus_ticks;
+    gov->up_count = 0;
+    gov->load = 0;
+    gov->bus_load = 0;
+    if (xTaskCreate(gov_thread, "mlx gov", LL_MLX90640_GOV_STACK_SIZE, gov, priority, &gov->thread) != pdPASS)
+    {
+        gov->thread = NULL;
+        return -ENOMEM;
+    }
     return 0;
 }
 
+/**
+ * @brief 标记开始处理一个子帧，在ll_mlx90640_acq_wait返回后调用
+ *
+ * @param gov 指向ll_mlx90640_gov
+ */
+void ll_mlx90640_gov_begin(struct ll_mlx90640_gov *gov)
+{
+    LL_ASSERT(gov);
+    gov->start = xTaskGetTickCount();
+}
+
+/**
+ * @brief 标记一个子帧处理和显示完成
+ *
+ * @param gov 指向ll_mlx90640_gov
+ */
+void ll_mlx90640_gov_end(struct ll_mlx90640_gov *gov)
+{
+    uint32_t temp;
+    TickType_t now = xTaskGetTickCount();
+
+    LL_ASSERT(gov);
+    temp = taskENTER_CRITICAL_FROM_ISR();
+    gov->busy += now - gov->start;
+    taskEXIT_CRITICAL_FROM_ISR(temp);
+}
+
 static inline void restoring_vdd_param(const struct ll_mlx90640_ee_buf *buf,
                                        struct ll_mlx90640_fixed_params *params)
 {
@@ -203,8 +737,10 @@ static inline void restoring_offset(const struct ll_mlx90640_ee_buf *buf,
     uint8_t occ_scale_remnant = (uint8_t)(buf->data[0x10] & 0x000f);
     int8_t occ_row[24];
     int8_t occ_col[32];
+#ifndef LL_MLX90640_USING_COMPACT_PARAMS
     const uint16_t *p_offset = &buf->data[0x40];
     int16_t *p_pix_os_ref = params->pix_os_ref;
+#endif
 
     for (i = 0; i < 6; i++)
     {
@@ -227,6 +763,15 @@ static inline void restoring_offset(const struct ll_mlx90640_ee_buf *buf,
         }
     }
 
+#ifdef LL_MLX90640_USING_COMPACT_PARAMS
+    for (i = 0; i < 24; i++)
+        params->os_row[i] = offset_avg + occ_row[i] * (1 << occ_scale_row);
+    for (j = 0; j < 32; j++)
+        params->os_col[j] = occ_col[j] * (1 << occ_scale_col);
+    params->os_scale_remnant = occ_scale_remnant;
+    //像素数据同时包含offset、alpha和kta的余量
+    memcpy(params->pix, &buf->data[0x40], sizeof(params->pix));
+#else
     for (i = 0; i < 24; i++)
     {
         for (j = 0; j < 32; j++)
@@ -240,6 +785,7 @@ static inline void restoring_offset(const struct ll_mlx90640_ee_buf *buf,
                               offset * (1 << occ_scale_remnant);
         }
     }
+#endif
 }
 
 static inline void restoring_sensitivity_alpha(const struct ll_mlx90640_ee_buf *buf,
@@ -252,8 +798,10 @@ static inline void restoring_sensitivity_alpha(const struct ll_mlx90640_ee_buf *
     uint8_t acc_scale_remnant = buf->data[0x20] & 0x000f;
     int8_t acc_row[24];
     int8_t acc_col[32];
+#ifndef LL_MLX90640_USING_COMPACT_PARAMS
     const uint16_t *p_a_pixel = &buf->data[0x40];
     int16_t *p_alpha = params->alpha;
+#endif
 
     params->alpha_scale = (buf->data[0x20] >> 12) + 30;
 
@@ -278,6 +826,13 @@ static inline void restoring_sensitivity_alpha(const struct ll_mlx90640_ee_buf *
         }
     }
 
+#ifdef LL_MLX90640_USING_COMPACT_PARAMS
+    for (i = 0; i < 24; i++)
+        params->alpha_row[i] = a_reference + acc_row[i] * (1 << acc_scale_row);
+    for (j = 0; j < 32; j++)
+        params->alpha_col[j] = acc_col[j] * (1 << acc_scale_col);
+    params->alpha_scale_remnant = acc_scale_remnant;
+#else
     for (i = 0; i < 24; i++)
     {
         for (j = 0; j < 32; j++)
@@ -291,11 +846,7 @@ static inline void restoring_sensitivity_alpha(const struct ll_mlx90640_ee_buf *
                          a_pixel * (1 << acc_scale_remnant);
         }
     }
-}
-
-static inline float read_alpha(struct ll_mlx90640_fixed_params *params, int i)
-{
-    return (float)params->alpha[i] / (1 << params->alpha_scale);
+#endif
 }
 
 static inline void restoring_kv(const struct ll_mlx90640_ee_buf *buf,
@@ -320,20 +871,16 @@ static inline void restoring_kv(const struct ll_mlx90640_ee_buf *buf,
     }
 }
 
-static inline float read_kv(struct ll_mlx90640_fixed_params *params,
-                            uint8_t x,
-                            uint8_t y)
-{
-    return params->kv[y % 2][x % 2];
-}
-
 static inline void restoring_kta(const struct ll_mlx90640_ee_buf *buf,
                                  struct ll_mlx90640_fixed_params *params)
 {
-    int i, j;
     int8_t kta_rc_ee[2][2];
     uint8_t kta_scale_2 = (uint8_t)(buf->data[0x38] & 0x000f);
+#ifndef LL_MLX90640_USING_COMPACT_PARAMS
+    int i, j;
+    const uint16_t *p_kta_ee = &buf->data[0x40];
     int16_t *p_kta = params->kta;
+#endif
 
     kta_rc_ee[0][0] = (int8_t)((buf->data[0x36] & 0xff00) >> 8);
     kta_rc_ee[1][0] = (int8_t)(buf->data[0x36] & 0x00ff);
@@ -342,16 +889,21 @@ static inline void restoring_kta(const struct ll_mlx90640_ee_buf *buf,
 
     params->kta_scale_1 = (uint8_t)(((buf->data[0x38] & 0x00f0) >> 4) + 8);
 
+#ifdef LL_MLX90640_USING_COMPACT_PARAMS
+    memcpy(params->kta_rc, kta_rc_ee, sizeof(kta_rc_ee));
+    params->kta_scale_2 = kta_scale_2;
+#else
     for (i = 0; i < 24; i++)
     {
         for (j = 0; j < 32; j++)
         {
-            int8_t kta_ee = (int8_t)((buf->data[0x40] & 0x000e) >> 1);
+            int8_t kta_ee = (int8_t)((*p_kta_ee++ & 0x000e) >> 1);
             if (kta_ee > 3)
                 kta_ee -= 8;
             *p_kta++ = kta_rc_ee[i % 2][j % 2] + kta_ee * (1 << kta_scale_2);
         }
     }
+#endif
 }
 
 static inline void restoring_gain(const struct ll_mlx90640_ee_buf *buf,
@@ -364,7 +916,7 @@ static inline void restoring_ks_ta(const struct ll_mlx90640_ee_buf *buf,
                                    struct ll_mlx90640_fixed_params *params)
 {
     int8_t ks_ta_ee = (int8_t)((buf->data[0x3c] & 0xff00) >> 8);
-    params->ks_ta = ks_ta_ee / (1 << 13);
+    params->ks_ta = (float)ks_ta_ee / (1 << 13);
 }
 
 static inline void restoring_corner_temp(const struct ll_mlx90640_ee_buf *buf,
@@ -405,7 +957,7 @@ static inline void restoring_sensitivity_a_cp(const struct ll_mlx90640_ee_buf *b
     cp_p1_p0_ratio = (int8_t)((buf->data[0x39] & 0xfc00) >> 10);
     if (cp_p1_p0_ratio > 31)
         cp_p1_p0_ratio -= 64;
-    params->a_cp_subpage[0] = (float)((int16_t)(buf->data[0x39] & 0x03ff)) / (1 << a_scale_cp);
+    params->a_cp_subpage[0] = ldexpf((int16_t)(buf->data[0x39] & 0x03ff), -a_scale_cp);
     params->a_cp_subpage[1] = params->a_cp_subpage[0] * (1 + (float)cp_p1_p0_ratio / (1 << 7));
 }
 
@@ -449,13 +1001,131 @@ static inline void restoring_resolution(const struct ll_mlx90640_ee_buf *buf,
     params->resolution_ee = (uint8_t)((buf->data[0x38] & 0x3000) >> 12);
 }
 
+static inline void restoring_il_chess(const struct ll_mlx90640_ee_buf *buf,
+                                      struct ll_mlx90640_fixed_params *params)
+{
+    int8_t temp;
+
+    params->calib_pattern = buf->data[0x0a] & 0x0800 ? LL_MLX90640_PATTERN_INTERLEAVED : LL_MLX90640_PATTERN_CHESS;
+    temp = (int8_t)(buf->data[0x35] & 0x003f);
+    if (temp > 31)
+        temp -= 64;
+    params->il_chess_c[0] = (float)temp / (1 << 4);
+    temp = (int8_t)((buf->data[0x35] & 0x07c0) >> 6);
+    if (temp > 15)
+        temp -= 32;
+    params->il_chess_c[1] = (float)temp / (1 << 1);
+    temp = (int8_t)((buf->data[0x35] & 0xf800) >> 11);
+    if (temp > 15)
+        temp -= 32;
+    params->il_chess_c[2] = (float)temp / (1 << 3);
+}
+
+/**
+ * @brief 找出eeprom中标记的坏点(像素数据为0)和异常点(outlier位为1)，并预先计算用于插值的相邻像素
+ *
+ * @param buf 指向eeprom数据
+ * @param params 用于保存校准参数
+ */
+static inline void restoring_bad_pixel(const struct ll_mlx90640_ee_buf *buf,
+                                       struct ll_mlx90640_fixed_params *params)
+{
+    static const int8_t dir[4][2] = {{-1, 0}, {1, 0}, {0, -1}, {0, 1}};
+    int n, k, m, i, j;
+    uint16_t nbr;
+
+    params->bad_pixel_numb = 0;
+    for (n = 0; n < 768; n++)
+    {
+        if (buf->data[0x40 + n] && !(buf->data[0x40 + n] & 0x0001))
+            continue;
+        if (params->bad_pixel_numb >= LL_MLX90640_MAX_BAD_PIXELS)
+        {
+            LL_WARN("too many bad pixels");
+            break;
+        }
+        params->bad_pixel[params->bad_pixel_numb++] = n;
+    }
+
+    //相邻的坏点不参与插值
+    for (k = 0; k < params->bad_pixel_numb; k++)
+    {
+        n = params->bad_pixel[k];
+        params->bad_pixel_nbr_numb[k] = 0;
+        for (i = 0; i < 4; i++)
+        {
+            int row = (n >> 5) + dir[i][0];
+            int col = (n & 31) + dir[i][1];
+
+            if (row < 0 || row >= 24 || col < 0 || col >= 32)
+                continue;
+            nbr = (row << 5) + col;
+            for (m = 0; m < params->bad_pixel_numb; m++)
+            {
+                if (params->bad_pixel[m] == nbr)
+                    break;
+            }
+            if (m < params->bad_pixel_numb)
+                continue;
+            j = params->bad_pixel_nbr_numb[k]++;
+            params->bad_pixel_nbr[k][j] = nbr;
+        }
+    }
+}
+
+static inline int16_t pixel_alpha(const struct ll_mlx90640_fixed_params *params, int n);
+
+/**
+ * @brief 计算alpha的归一化倒数
+ *
+ * alpha左移到[2^15, 2^16)得到m，保存round(2^32 / m) - 2^16，
+ * 使用时由alpha的前导零个数恢复移位，相对误差不超过2^-16
+ *
+ * @param alpha alpha参数，不大于0时按1处理
+ * @return uint16_t 倒数的小数部分
+ */
+static inline uint16_t alpha_inv_calculate(int16_t alpha)
+{
+    uint32_t m = alpha > 0 ? (uint32_t)alpha : 1;
+    uint32_t inv;
+
+    m <<= __builtin_clz(m) - 16;
+    inv = (uint32_t)((((uint64_t)1 << 32) + m / 2) / m) - 65536;
+    return inv > 65535 ? 65535 : (uint16_t)inv;
+}
+
+/**
+ * @brief 预先计算每个像素与Ta无关的alpha倒数，没有系数缓存时像素循环也不需要除法
+ */
+static inline void restoring_alpha_inv(struct ll_mlx90640_fixed_params *params)
+{
+    int n;
+
+    for (n = 0; n < 768; n++)
+        params->alpha_inv[n] = alpha_inv_calculate(pixel_alpha(params, n));
+}
+
+#ifdef LL_MLX90640_USING_FIXED_POINT
+static inline void restoring_fixed_point(struct ll_mlx90640_fixed_params *params)
+{
+    int i;
+
+    for (i = 0; i < 4; i++)
+    {
+        params->ct_q6[i] = params->ct[i] * (1 << 6);
+        params->ks_to_q30[i] = lroundf(ldexpf(params->ks_to[i], 30));
+        params->alpha_corr_range_q28[i] = lroundf(ldexpf(params->alpha_corr_range[i], 28));
+    }
+}
+#endif
+
 int ll_mlx90640_get_params(struct ll_mlx90640 *handle,
                            struct ll_mlx90640_ee_buf *buf,
                            struct ll_mlx90640_fixed_params *params)
 {
     int res;
 
-    READ_16BITS(handle, 0x2400, buf->data, sizeof(struct ll_mlx90640_ee_buf) >> 1);
+    READ_16BITS(handle, EE_ADDR, buf->data, sizeof(struct ll_mlx90640_ee_buf) >> 1);
     restoring_vdd_param(buf, params);
     restoring_ta_param(buf, params);
     restoring_offset(buf, params);
@@ -473,26 +1143,232 @@ int ll_mlx90640_get_params(struct ll_mlx90640 *handle,
     restoring_kta_cp(buf, params);
     restoring_tgc(buf, params);
     restoring_resolution(buf, params);
+    restoring_il_chess(buf, params);
+    restoring_bad_pixel(buf, params);
+    restoring_alpha_inv(params);
+#ifdef LL_MLX90640_USING_FIXED_POINT
+    restoring_fixed_point(params);
+#endif
     return 0;
 }
 
-static inline float vdd_diff_calculate(struct ll_mlx90640_fixed_params *params,
-                                       struct ll_mlx90640_ram_buf *buf)
+#define CALIB_MAGIC   0x4330394d // "M90C"
+#define CALIB_VERSION 3
+
+/**
+ * @brief flash中校准参数缓存的头部，参数紧跟在头部之后
+ */
+struct calib_header
 {
-    int16_t temp;
-    float resolution_reg;
+    uint32_t magic;
+    uint16_t version;
+    uint16_t size;  //参数的字节数，参数结构或定点配置改变后缓存自动失效
+    uint16_t id[3]; //传感器的器件ID
+    uint16_t reserved;
+    uint32_t crc; //参数的crc32
+};
+
+static uint32_t crc32(const void *buf, size_t size)
+{
+    const uint8_t *p = (const uint8_t *)buf;
+    uint32_t crc = 0xffffffff;
+    int i;
 
-    resolution_reg = (float)(1 << params->resolution_ee) / (1 << 2);
-    temp = (int16_t)(buf->params[0x2a]);
-    return (resolution_reg * temp - params->vdd25) / params->kvdd;
+    while (size--)
+    {
+        crc ^= *p++;
+        for (i = 0; i < 8; i++)
+            crc = (crc >> 1) ^ (0xedb88320 & -(crc & 1));
+    }
+    return ~crc;
 }
 
-static inline float ta_diff_calculate(struct ll_mlx90640_fixed_params *params,
-                                      struct ll_mlx90640_ram_buf *data,
-                                      float v_diff)
-{
-    float ta_diff;
-    int16_t v_ptat = (int16_t)data->params[0x0020];
+/**
+ * @brief 从flash中加载校准参数，只有版本、大小、器件ID和crc全部匹配时才有效
+ *
+ * @param handle 指向ll_mlx90640
+ * @param flash 指向保存校准参数的flash区域
+ * @param params 用于保存校准参数
+ * @return int 成功返回0，缓存无效返回-ENOENT，其他错误返回一个负数
+ */
+int ll_mlx90640_load_params(struct ll_mlx90640 *handle,
+                            struct ll_flash *flash,
+                            struct ll_mlx90640_fixed_params *params)
+{
+    int res;
+    struct calib_header header;
+    uint16_t id[3];
+
+    LL_ASSERT(handle && flash && params);
+    READ_16BITS(handle, EE_ID_ADDR, id, 3);
+    res = ll_flash_read(flash, 0, &header, sizeof(struct calib_header));
+    if (res)
+        return res;
+    if (header.magic != CALIB_MAGIC ||
+        header.version != CALIB_VERSION ||
+        header.size != sizeof(struct ll_mlx90640_fixed_params) ||
+        memcmp(header.id, id, sizeof(id)))
+        return -ENOENT;
+    res = ll_flash_read(flash, sizeof(struct calib_header), params, sizeof(struct ll_mlx90640_fixed_params));
+    if (res)
+        return res;
+    if (crc32(params, sizeof(struct ll_mlx90640_fixed_params)) != header.crc)
+        return -ENOENT;
+
+    return 0;
+}
+
+/**
+ * @brief 将校准参数保存到flash中，先写参数后写头部，中途掉电时缓存保持无效
+ *
+ * @param handle 指向ll_mlx90640
+ * @param flash 指向保存校准参数的flash区域
+ * @param params 指向由ll_mlx90640_get_params得到的校准参数
+ * @return int 成功返回0，失败返回一个负数
+ */
+int ll_mlx90640_save_params(struct ll_mlx90640 *handle,
+                            struct ll_flash *flash,
+                            struct ll_mlx90640_fixed_params *params)
+{
+    int res;
+    struct calib_header header;
+
+    LL_ASSERT(handle && flash && params);
+    if (sizeof(struct calib_header) + sizeof(struct ll_mlx90640_fixed_params) > flash->size)
+        return -ENOSPC;
+    READ_16BITS(handle, EE_ID_ADDR, header.id, 3);
+    header.magic = CALIB_MAGIC;
+    header.version = CALIB_VERSION;
+    header.size = sizeof(struct ll_mlx90640_fixed_params);
+    header.reserved = 0xffff;
+    header.crc = crc32(params, sizeof(struct ll_mlx90640_fixed_params));
+
+    res = ll_flash_erase(flash, 0, sizeof(struct calib_header) + sizeof(struct ll_mlx90640_fixed_params));
+    if (res)
+        return res;
+    res = ll_flash_write(flash, sizeof(struct calib_header), params, sizeof(struct ll_mlx90640_fixed_params));
+    if (res)
+        return res;
+    return ll_flash_write(flash, 0, &header, sizeof(struct calib_header));
+}
+
+/**
+ * @brief 获取像素的offset参数
+ *
+ * @param params 指向校准参数
+ * @param n 像素序号
+ * @return int16_t offset参数
+ */
+static inline int16_t pixel_offset(const struct ll_mlx90640_fixed_params *params, int n)
+{
+#ifdef LL_MLX90640_USING_COMPACT_PARAMS
+    int16_t remnant = (int16_t)params->pix[n] >> 10;
+    return (int16_t)(params->os_row[n >> 5] + params->os_col[n & 31] + remnant * (1 << params->os_scale_remnant));
+#else
+    return params->pix_os_ref[n];
+#endif
+}
+
+/**
+ * @brief 获取像素的alpha参数
+ *
+ * @param params 指向校准参数
+ * @param n 像素序号
+ * @return int16_t alpha参数，单位2^-alpha_scale
+ */
+static inline int16_t pixel_alpha(const struct ll_mlx90640_fixed_params *params, int n)
+{
+#ifdef LL_MLX90640_USING_COMPACT_PARAMS
+    int16_t remnant = (int16_t)(params->pix[n] << 6) >> 10;
+    return (int16_t)(params->alpha_row[n >> 5] + params->alpha_col[n & 31] + remnant * (1 << params->alpha_scale_remnant));
+#else
+    return params->alpha[n];
+#endif
+}
+
+/**
+ * @brief 获取像素的kta参数
+ *
+ * @param params 指向校准参数
+ * @param n 像素序号
+ * @return int16_t kta参数，单位2^-kta_scale_1
+ */
+static inline int16_t pixel_kta(const struct ll_mlx90640_fixed_params *params, int n)
+{
+#ifdef LL_MLX90640_USING_COMPACT_PARAMS
+    int16_t remnant = (int16_t)(params->pix[n] << 12) >> 13;
+    return (int16_t)(params->kta_rc[(n >> 5) & 1][n & 1] + remnant * (1 << params->kta_scale_2));
+#else
+    return params->kta[n];
+#endif
+}
+
+struct frame_coef
+{
+    float v_diff;
+    float ta_diff;
+    float kgain;
+    float kg_e; //kgain/emissivity
+    float kv_vdd[2][2];
+    float kta_ta;
+    float alpha_scale;
+    float ks_ta;
+    float inv_ks_ta;
+    float pix_os_cp_tgc[2];
+    float alpha_cp_tgc[2];
+    float inv_emissivity;
+    float ta_r;
+    float ks_to2_k;
+    float il_offset[2][4]; //读取模式与校准时不同时offset的修正量，按行的奇偶和像素序号%4区分
+    uint8_t chess;         //1 棋盘模式，0 隔行模式
+
+#ifdef LL_MLX90640_USING_FIXED_POINT
+    int32_t kg_e_q24;       //kgain/emissivity
+    int32_t kv_e_q24[2][2]; //(1+kv*ΔV)/emissivity
+    int32_t kta_ta_q20;     //ΔTa
+    int32_t cp_tgc_q8[2];   //tgc*pix_os_cp
+    int32_t acp_tgc_q4[2];  //tgc*alpha_cp，单位为params->alpha的1/16
+    int32_t inv_ks_ta_q30;  //1/(1+ks_ta*ΔTa)
+    int32_t ta_r_u8;        //Ta_r，单位2^8 K^4
+    int32_t il_offset_q8[2][4];
+    uint8_t kta_shift;      //kta_scale_1 - 8
+    int8_t alpha_shift;     //alpha_scale - 12，用于把v_ir/alpha换算为2^8 K^4
+#endif
+};
+
+/**
+ * @brief 获取像素所属的子界面
+ *
+ * 棋盘模式下为(行 ^ 列) & 1，隔行模式下为行 & 1
+ *
+ * @param coef 指向每帧的补偿系数
+ * @param n 像素序号
+ * @return int 子界面号
+ */
+static inline int pixel_subpage(struct frame_coef *coef, int n)
+{
+    return ((n >> 5) ^ (n & coef->chess)) & 1;
+}
+
+static inline float vdd_diff_calculate(struct ll_mlx90640_fixed_params *params,
+                                       struct ll_mlx90640_ram_buf *buf)
+{
+    int16_t temp;
+    float resolution_reg;
+
+    //eeprom中的参数对应resolution_ee，按测量时的实际分辨率换算
+    resolution_reg = (float)(1 << params->resolution_ee) /
+                     (1 << ((buf->ctrl & RESOLUTION_CTRL_MASK) >> RESOLUTION_CTRL_POS));
+    temp = (int16_t)(buf->params[0x2a]);
+    return (resolution_reg * temp - params->vdd25) / params->kvdd;
+}
+
+static inline float ta_diff_calculate(struct ll_mlx90640_fixed_params *params,
+                                      struct ll_mlx90640_ram_buf *data,
+                                      float v_diff)
+{
+    float ta_diff;
+    int16_t v_ptat = (int16_t)data->params[0x0020];
     int16_t v_be = (int16_t)data->params[0x0000];
     float v_ptat_art;
 
@@ -510,51 +1386,1534 @@ static inline float kgain_calculate(struct ll_mlx90640_fixed_params *params,
     return (float)params->gain / temp;
 }
 
-static inline ir_data_compensation(struct ll_mlx90640_fixed_params *params,
-                                   struct ll_mlx90640_ram_buf *buf,
-                                   struct ll_mlx90640_ir_data *data,
-                                   float kgain,
-                                   float ta_diff,
-                                   float v_diff)
+/**
+ * @brief 计算每帧只需计算一次的补偿系数
+ *
+ * @param handle 指向ll_mlx90640
+ * @param params 指向校准参数
+ * @param buf 指向ram数据
+ * @param coef 用于保存计算结果
+ */
+static void frame_coef_calculate(struct ll_mlx90640 *handle,
+                                 struct ll_mlx90640_fixed_params *params,
+                                 struct ll_mlx90640_ram_buf *buf,
+                                 struct frame_coef *coef)
 {
-    int i, j;
-    int16_t *src = (int16_t *)buf->data;
-    int16_t *p_off = params->pix_os_ref;
-    int16_t *p_kta = params->kta;
-    float *dst = data->temp;
+    int i, k;
+    float ta_k4, tr_k4, cp_il;
+    static const int8_t conversion_pattern[4] = {0, -1, 0, 1};
+
+    coef->chess = buf->ctrl & READING_PATTERN_BIT ? 1 : 0;
+    coef->v_diff = vdd_diff_calculate(params, buf);
+    coef->ta_diff = ta_diff_calculate(params, buf, coef->v_diff);
+    coef->kgain = kgain_calculate(params, buf);
+    for (i = 0; i < 4; i++)
+        coef->kv_vdd[i >> 1][i & 1] = 1 + params->kv[i >> 1][i & 1] * coef->v_diff;
+    coef->kta_ta = coef->ta_diff / (1 << params->kta_scale_1);
+    coef->alpha_scale = ldexpf(1, -params->alpha_scale);
+    coef->ks_ta = 1 + params->ks_ta * coef->ta_diff;
+    coef->inv_ks_ta = 1 / coef->ks_ta;
+    coef->inv_emissivity = 1 / handle->emissivity;
+    coef->kg_e = coef->kgain * coef->inv_emissivity;
+
+    //读取模式与校准时不同时修正offset和子界面1的补偿像素
+    cp_il = 0;
+    memset(coef->il_offset, 0, sizeof(coef->il_offset));
+    if (coef->chess != (params->calib_pattern == LL_MLX90640_PATTERN_CHESS))
+    {
+        cp_il = params->il_chess_c[0];
+        for (i = 0; i < 2; i++)
+        {
+            for (k = 0; k < 4; k++)
+                coef->il_offset[i][k] = (params->il_chess_c[1] * conversion_pattern[k] * (1 - 2 * i) -
+                                         params->il_chess_c[2] * (2 * i - 1)) *
+                                        coef->inv_emissivity;
+        }
+    }
+
+    //补偿像素，两个子界面各一个
+    for (i = 0; i < 2; i++)
+    {
+        float pix_os_cp = (int16_t)buf->params[i ? 0x28 : 0x08] * coef->kgain;
+        pix_os_cp -= (params->off_cp_subpage[i] + (i ? cp_il : 0)) *
+                     (1 + params->kta_cp * coef->ta_diff) *
+                     (1 + params->kv_cp * coef->v_diff);
+        coef->pix_os_cp_tgc[i] = params->tgc * pix_os_cp;
+        coef->alpha_cp_tgc[i] = params->tgc * params->a_cp_subpage[i];
+    }
+
+    //反射温度取环境温度-8℃
+    ta_k4 = coef->ta_diff + 25 + 273.15f;
+    ta_k4 *= ta_k4;
+    ta_k4 *= ta_k4;
+    tr_k4 = coef->ta_diff + 25 - 8 + 273.15f;
+    tr_k4 *= tr_k4;
+    tr_k4 *= tr_k4;
+    coef->ta_r = tr_k4 - (tr_k4 - ta_k4) * coef->inv_emissivity;
+    coef->ks_to2_k = 1 - params->ks_to[1] * 273.15f;
+
+#ifdef LL_MLX90640_USING_FIXED_POINT
+    coef->kg_e_q24 = lroundf(ldexpf(coef->kgain * coef->inv_emissivity, 24));
+    for (i = 0; i < 4; i++)
+        coef->kv_e_q24[i >> 1][i & 1] = lroundf(ldexpf(coef->kv_vdd[i >> 1][i & 1] * coef->inv_emissivity, 24));
+    coef->kta_ta_q20 = lroundf(ldexpf(coef->ta_diff, 20));
+    coef->kta_shift = params->kta_scale_1 - 8;
+    for (i = 0; i < 2; i++)
+    {
+        coef->cp_tgc_q8[i] = lroundf(ldexpf(coef->pix_os_cp_tgc[i], 8));
+        coef->acp_tgc_q4[i] = lroundf(ldexpf(coef->alpha_cp_tgc[i], params->alpha_scale + 4));
+    }
+    for (i = 0; i < 8; i++)
+        coef->il_offset_q8[i >> 2][i & 3] = lroundf(ldexpf(coef->il_offset[i >> 2][i & 3], 8));
+    coef->inv_ks_ta_q30 = lroundf(ldexpf(coef->inv_ks_ta, 30));
+    coef->ta_r_u8 = (int32_t)ldexpf(coef->ta_r, -8);
+    coef->alpha_shift = params->alpha_scale - 12;
+#endif
+}
+
+/*
+ * 倒数和四次方根的查表计算：x = m * 2^e，m在[1, 2)内，1/x = (1/m) * 2^-e，
+ * 四次方根的计算：x = m * 2^e，m在[1, 2)内，
+ * x^(1/4) = m^(1/4) * 2^((e & 3) / 4) * 2^(e >> 2)。
+ * 1/m和m^(1/4)都把[1, 2)分为32段，每段用以段内位置s(0 <= s < 1)为变量的二次多项式近似，系数按最小最大误差拟合，
+ * 多项式本身的相对误差分别小于9e-7和6e-8
+ */
+#ifndef LL_MLX90640_USING_FIXED_POINT
+static const float recip_coef[32][3] = {
+    {0.999999103f, -0.0312336931f, 0.000932456111f},
+    {0.969696175f, -0.0293703162f, 0.000851405601f},
+    {0.941175764f, -0.0276688273f, 0.000779483144f},
+    {0.914285084f, -0.0261110048f, 0.000715439015f},
+    {0.888888325f, -0.0246811202f, 0.00065822332f},
+    {0.864864359f, -0.0233655398f, 0.000606949689f},
+    {0.842104808f, -0.0221523984f, 0.000560866316f},
+    {0.82051241f, -0.0210313315f, 0.000519332716f},
+    {0.799999628f, -0.0199932525f, 0.000481800955f},
+    {0.780487468f, -0.019030169f, 0.000447800419f},
+    {0.761904455f, -0.0181350276f, 0.000416925377f},
+    {0.744185767f, -0.0173015853f, 0.00038882478f},
+    {0.727272472f, -0.0165242999f, 0.000363193849f},
+    {0.711110878f, -0.0157982376f, 0.000339767119f},
+    {0.69565196f, -0.0151189949f, 0.000318312644f},
+    {0.680850867f, -0.0144826314f, 0.00029862716f},
+    {0.666666486f, -0.0138856127f, 0.000280532035f},
+    {0.653061058f, -0.0133247612f, 0.000263869852f},
+    {0.639999846f, -0.0127972136f, 0.000248501528f},
+    {0.627450838f, -0.0123003845f, 0.000234303871f},
+    {0.615384484f, -0.0118319347f, 0.000221167501f},
+    {0.603773463f, -0.0113897432f, 0.000208995074f},
+    {0.592592479f, -0.0109718838f, 0.000197699771f},
+    {0.581818076f, -0.0105766036f, 0.000187203986f},
+    {0.571428473f, -0.0102023046f, 0.000177438211f},
+    {0.561403417f, -0.00984752793f, 0.000168340066f},
+    {0.551724053f, -0.00951093925f, 0.000159853459f},
+    {0.542372802f, -0.00919131629f, 0.000151927859f},
+    {0.533333259f, -0.00888753777f, 0.000144517664f},
+    {0.524590094f, -0.00859857351f, 0.00013758165f},
+    {0.516128967f, -0.00832347572f, 0.000131082486f},
+    {0.507936446f, -0.00806137123f, 0.000124986314f},
+};
+
+/**
+ * @brief 求倒数，代替浮点除法
+ *
+ * 只需要2次乘法和3次加减法，相对误差不超过1e-6；x不是正的规格化数或1/x不是规格化数时使用除法
+ *
+ * @param x 输入
+ * @return float 1/x
+ */
+static inline float recipf(float x)
+{
+    union
+    {
+        float f;
+        uint32_t u;
+    } v = {x};
+    const float *c;
+    float s;
+    int e;
+
+    if (!(x >= FLT_MIN && x < 1 / FLT_MIN))
+        return 1 / x;
+    e = (int)(v.u >> 23) - 127;
+    c = recip_coef[(v.u >> 18) & 31];
+    v.u = (v.u & 0x3ffff) | 0x3f800000;
+    s = (v.f - 1) * 32;
+    v.f = c[0] + s * (c[1] + s * c[2]);
+    v.u -= (uint32_t)e << 23;
+    return v.f;
+}
+
+static const float root4_coef[32][3] = {
+    {1.00000005f, 0.00781159385f, -8.91126656e-05f},
+    {1.00772263f, 0.00763342847f, -8.45091771e-05f},
+    {1.01527163f, 0.00746446372f, -8.02686757e-05f},
+    {1.02265591f, 0.00730397445f, -7.63532198e-05f},
+    {1.02988361f, 0.00715131126f, -7.27297553e-05f},
+    {1.03696226f, 0.00700589078f, -6.93693732e-05f},
+    {1.04389885f, 0.00686718735f, -6.62466967e-05f},
+    {1.05069985f, 0.00673472599f, -6.33393717e-05f},
+    {1.05737129f, 0.00660807638f, -6.06276418e-05f},
+    {1.06391879f, 0.00648684766f, -5.80939916e-05f},
+    {1.0703476f, 0.00637068393f, -5.57228459e-05f},
+    {1.0766626f, 0.00625926045f, -5.3500316e-05f},
+    {1.08286841f, 0.0061522802f, -5.1413983e-05f},
+    {1.08896931f, 0.00604947096f, -4.94527138e-05f},
+    {1.09496937f, 0.00595058278f, -4.76065037e-05f},
+    {1.10087238f, 0.00585538568f, -4.58663403e-05f},
+    {1.10668194f, 0.00576366771f, -4.42240873e-05f},
+    {1.11240141f, 0.00567523314f, -4.26723832e-05f},
+    {1.118034f, 0.00558990099f, -4.12045536e-05f},
+    {1.12358273f, 0.00550750359f, -3.98145355e-05f},
+    {1.12905045f, 0.00542788541f, -3.84968105e-05f},
+    {1.13443986f, 0.00535090193f, -3.72463466e-05f},
+    {1.13975354f, 0.00527641869f, -3.60585474e-05f},
+    {1.14499392f, 0.00520431042f, -3.49292075e-05f},
+    {1.15016333f, 0.00513446025f, -3.38544723e-05f},
+    {1.15526395f, 0.00506675902f, -3.28308038e-05f},
+    {1.1602979f, 0.00500110464f, -3.18549495e-05f},
+    {1.16526717f, 0.00493740153f, -3.09239147e-05f},
+    {1.17017367f, 0.00487556006f, -3.00349385e-05f},
+    {1.17501921f, 0.00481549617f, -2.91854719e-05f},
+    {1.17980554f, 0.00475713086f, -2.83731586e-05f},
+    {1.18453431f, 0.00470038984f, -2.75958173e-05f},
+};
+
+static const float root4_scale[4] = {1.0f, 1.18920712f, 1.41421356f, 1.68179283f};
+
+/**
+ * @brief 求四次方根，代替sqrtf(sqrtf(x))
+ *
+ * 只需要3次乘法和3次加减法，相对误差不超过2.5e-7，
+ * -40~300℃内换算得到的温度误差不超过1e-4℃；x不是正的规格化数时使用sqrtf
+ *
+ * @param x 输入
+ * @return float x的四次方根
+ */
+static inline float root4f(float x)
+{
+    union
+    {
+        float f;
+        uint32_t u;
+    } v = {x};
+    const float *c;
+    float s;
+    int e;
+
+    if (!(x >= FLT_MIN && x <= FLT_MAX))
+        return sqrtf(sqrtf(x));
+    e = (int)(v.u >> 23) - 127;
+    c = root4_coef[(v.u >> 18) & 31];
+    //尾数的低18位即为段内位置
+    v.u = (v.u & 0x3ffff) | 0x3f800000;
+    s = (v.f - 1) * 32;
+    v.f = (c[0] + s * (c[1] + s * c[2])) * root4_scale[e & 3];
+    v.u += (uint32_t)(e >> 2) << 23;
+    return v.f;
+}
+
+static inline float to_range_calculate(struct ll_mlx90640_fixed_params *params,
+                                       struct frame_coef *coef,
+                                       float e,
+                                       float to)
+{
+    int r;
+
+    if (to < params->ct[1])
+        r = 0;
+    else if (to < params->ct[2])
+        r = 1;
+    else if (to < params->ct[3])
+        r = 2;
+    else
+        r = 3;
+    to = e * recipf(params->alpha_corr_range[r] * (1 + params->ks_to[r] * (to - params->ct[r]))) + coef->ta_r;
+    return root4f(to) - 273.15f;
+}
+
+/**
+ * @brief 计算像素经过Ta、Vdd和发射率补偿后的offset，只与Ta、Vdd和发射率有关
+ *
+ * @param params 指向校准参数
+ * @param coef 指向每帧的补偿系数
+ * @param n 像素序号
+ * @return float 有效offset
+ */
+static inline float pixel_offset_eff(struct ll_mlx90640_fixed_params *params, struct frame_coef *coef, int n)
+{
+    int i = n >> 5, j = n & 31;
+
+    return pixel_offset(params, n) *
+           (1 + pixel_kta(params, n) * coef->kta_ta) *
+           coef->kv_vdd[i & 1][j & 1] *
+           coef->inv_emissivity +
+           coef->il_offset[i & 1][j & 3];
+}
+
+/**
+ * @brief 计算像素经过补偿像素和Ta补偿后的alpha的倒数，只与Ta有关
+ *
+ * 由params->alpha_inv直接拼出r = 1/alpha的浮点数，
+ * 1/((alpha - alpha_cp_tgc) * ks_ta) = r / (1 - alpha_cp_tgc * r) / ks_ta，不使用除法
+ *
+ * @param params 指向校准参数
+ * @param coef 指向每帧的补偿系数
+ * @param n 像素序号
+ * @return float 有效alpha的倒数
+ */
+static inline float pixel_alpha_inv(struct ll_mlx90640_fixed_params *params, struct frame_coef *coef, int n)
+{
+    int pattern = pixel_subpage(coef, n);
+    int16_t alpha = pixel_alpha(params, n);
+    union
+    {
+        float f;
+        uint32_t u;
+    } r;
+
+    //r = (1 + alpha_inv / 2^16) * 2^(alpha_scale + clz - 32)
+    r.u = (uint32_t)(127 + params->alpha_scale + __builtin_clz(alpha > 0 ? alpha : 1) - 32) << 23 |
+          (uint32_t)params->alpha_inv[n] << 7;
+    return r.f * recipf(1 - coef->alpha_cp_tgc[pattern] * r.f) * coef->inv_ks_ta;
+}
+
+/**
+ * @brief 计算像素的辐射量e = v_ir / alpha，与(To^4 - Ta_r)近似成正比，单位K^4
+ *
+ * @param coef 指向每帧的补偿系数
+ * @param raw 像素的ram数据
+ * @param subpage 像素所属的子界面
+ * @param offset 有效offset
+ * @param inv_alpha 有效alpha的倒数
+ * @return float e
+ */
+static inline float pixel_e(struct frame_coef *coef, int16_t raw, int subpage, float offset, float inv_alpha)
+{
+    return (raw * coef->kg_e - offset - coef->pix_os_cp_tgc[subpage]) * inv_alpha;
+}
+
+/**
+ * @brief 计算单个像素的温度，不使用除法
+ *
+ * Sx = ks_to2 * alpha * (v_ir / alpha + Ta_r)^(1/4)，因此整个计算只需要e = v_ir / alpha
+ *
+ * @param params 指向校准参数
+ * @param coef 指向每帧的补偿系数
+ * @param raw 像素的ram数据
+ * @param subpage 像素所属的子界面
+ * @param offset 有效offset
+ * @param inv_alpha 有效alpha的倒数
+ * @return float 温度，单位℃
+ */
+static inline float to_pixel_calculate(struct ll_mlx90640_fixed_params *params,
+                                       struct frame_coef *coef,
+                                       int16_t raw,
+                                       int subpage,
+                                       float offset,
+                                       float inv_alpha)
+{
+    float e, sx, to;
+
+    e = pixel_e(coef, raw, subpage, offset, inv_alpha);
+    sx = params->ks_to[1] * root4f(e + coef->ta_r);
+    to = root4f(e * recipf(coef->ks_to2_k + sx) + coef->ta_r) - 273.15f;
+    return to_range_calculate(params, coef, e, to);
+}
+#endif
+
+#ifdef LL_MLX90640_USING_FIXED_POINT
+#define FIX_MUL(a, b, sh) ((int32_t)(((int64_t)(a) * (b)) >> (sh)))
+#define KELVIN_Q6         17482 // 273.15 * 64
+
+static const int32_t root4_coef[32][3] = {
+    {1073741878, 8387635, -95684},
+    {1082033932, 8196331, -90741},
+    {1090139617, 8014907, -86188},
+    {1098068424, 7842583, -81984},
+    {1105829104, 7678662, -78093},
+    {1113429748, 7522518, -74485},
+    {1120877851, 7373586, -71132},
+    {1128180371, 7231357, -68010},
+    {1135343778, 7095368, -65098},
+    {1142374105, 6965200, -62378},
+    {1149276979, 6840470, -59832},
+    {1156057667, 6720830, -57446},
+    {1162721098, 6605961, -55205},
+    {1169271897, 6495570, -53099},
+    {1175714409, 6389390, -51117},
+    {1182052720, 6287173, -49249},
+    {1188290681, 6188691, -47485},
+    {1194431921, 6093735, -45819},
+    {1200479870, 6002110, -44243},
+    {1206437769, 5913637, -42751},
+    {1212308685, 5828148, -41336},
+    {1218095525, 5745487, -39993},
+    {1223801046, 5665511, -38718},
+    {1229427865, 5588086, -37505},
+    {1234978470, 5513085, -36351},
+    {1240455226, 5440391, -35252},
+    {1245860387, 5369895, -34204},
+    {1251196099, 5301495, -33204},
+    {1256464409, 5235093, -32250},
+    {1261667271, 5170600, -31338},
+    {1266806552, 5107930, -30465},
+    {1271884034, 5047005, -29631},
+};
+
+static const int32_t root4_scale[4] = {1073741824, 1276901417, 1518500250, 1805811301}; // 2^(r/4)，Q30
+
+/**
+ * @brief 求四次方根
+ *
+ * 查表计算，结果的误差不超过0.51个最低位(约1/126 K)，其中0.5个最低位来自结果的舍入
+ *
+ * @param x 输入，单位2^8 K^4，小于等于0时返回0
+ * @return int32_t 开方结果，单位为K，Q6
+ */
+static inline int32_t root4_q6(int32_t x)
+{
+    const int32_t *c;
+    uint32_t u;
+    int32_t s, y;
+    int sh, e;
+
+    if (x <= 0)
+        return 0;
+    sh = __builtin_clz(x);
+    e = 31 - sh;
+    //u的最高位为1，接下来5位为段号，再往下16位为段内位置，Q16
+    u = (uint32_t)x << sh;
+    c = root4_coef[(u >> 26) & 31];
+    s = (u >> 10) & 0xffff;
+    y = c[0] + FIX_MUL(c[1] + FIX_MUL(c[2], s, 16), s, 16);
+    y = FIX_MUL(y, root4_scale[e & 3], 31);
+    //y为Q29，x^(1/4) * 2^8 = y * 2^(e >> 2) * 2^(8 - 29)
+    sh = 21 - (e >> 2);
+    return (y + (1 << (sh - 1))) >> sh;
+}
+
+/**
+ * @brief 计算x / d，d为正的Q28数
+ *
+ * @param x 被除数
+ * @param d_q28 除数，Q28
+ * @return int32_t 商
+ */
+static inline int32_t div_q28(int32_t x, int32_t d_q28)
+{
+    uint32_t inv = 0xffffffffUL / (uint32_t)(d_q28 >> 12);
+    return FIX_MUL(x, inv, 16);
+}
+
+static inline int32_t to_range_calculate_fixed(struct ll_mlx90640_fixed_params *params,
+                                               struct frame_coef *coef,
+                                               int32_t e,
+                                               int32_t to_q6)
+{
+    int r;
+    int32_t d;
+
+    if (to_q6 < params->ct_q6[1])
+        r = 0;
+    else if (to_q6 < params->ct_q6[2])
+        r = 1;
+    else if (to_q6 < params->ct_q6[3])
+        r = 2;
+    else
+        r = 3;
+    d = (1 << 28) + FIX_MUL(to_q6 - params->ct_q6[r], params->ks_to_q30[r], 8);
+    d = FIX_MUL(d, params->alpha_corr_range_q28[r], 28);
+    return root4_q6(div_q28(e, d) + coef->ta_r_u8) - KELVIN_Q6;
+}
+
+/**
+ * @brief 定点版本的有效offset，只与Ta、Vdd和发射率有关
+ *
+ * @param params 指向校准参数
+ * @param coef 指向每帧的补偿系数
+ * @param n 像素序号
+ * @return int32_t 有效offset，Q8
+ */
+static inline int32_t pixel_offset_eff(struct ll_mlx90640_fixed_params *params, struct frame_coef *coef, int n)
+{
+    int i = n >> 5, j = n & 31;
+    int32_t offset;
+
+    offset = (1 << 28) + FIX_MUL(pixel_kta(params, n), coef->kta_ta_q20, coef->kta_shift);
+    offset = FIX_MUL(pixel_offset(params, n), offset, 20);
+    return FIX_MUL(offset, coef->kv_e_q24[i & 1][j & 1], 24) + coef->il_offset_q8[i & 1][j & 3];
+}
+
+/**
+ * @brief 定点版本的有效alpha的倒数，只与Ta有关
+ *
+ * 有效alpha = 16 * alpha * (1 - x) * ks_ta，单位为2^-(alpha_scale+4)，x = alpha_cp_tgc / alpha，
+ * 由params->alpha_inv得到1/alpha，1 - x归一化到[0.5, 1)后由线性初值做两次牛顿迭代求倒数，不使用除法；
+ * 高24位为倒数，低8位为把v_ir * 倒数换算为e = v_ir / alpha(单位2^8 K^4)需要右移的位数
+ *
+ * @param params 指向校准参数
+ * @param coef 指向每帧的补偿系数
+ * @param n 像素序号
+ * @return int32_t 打包后的倒数和移位数
+ */
+static inline int32_t pixel_alpha_inv(struct ll_mlx90640_fixed_params *params, struct frame_coef *coef, int n)
+{
+    int pattern = pixel_subpage(coef, n);
+    int16_t alpha = pixel_alpha(params, n);
+    int sh = __builtin_clz(alpha > 0 ? alpha : 1) - 16;
+    uint32_t r = 65536 + params->alpha_inv[n]; //2^(32-sh) / alpha
+    int64_t x;
+    uint32_t d;
+    int32_t m, y, inv;
+    int k;
+
+    //x，Q30，只对异常像素限幅，保证1 - x在(0, 2]内
+    x = (coef->acp_tgc_q4[pattern] * ((int64_t)r << sh)) >> 6;
+    x = LL_MAX(LL_MIN(x, (1 << 30) - (1 << 10)), -(1 << 30));
+    d = (uint32_t)((1 << 30) - x);
+    //m = (1 - x) * 2^k，Q30，在[0.5, 1)内
+    k = __builtin_clz(d) - 2;
+    m = (int32_t)(k >= 0 ? d << k : d >> -k);
+    //y = 1/m，Q29，初值48/17 - 32/17 * m的相对误差不超过1/17，两次迭代后约为1e-5
+    y = 0x5a5a5a5a - FIX_MUL(m, 0x3c3c3c3c, 30);
+    y = FIX_MUL(y, (1 << 30) - FIX_MUL(m, y, 30), 29);
+    y = FIX_MUL(y, (1 << 30) - FIX_MUL(m, y, 30), 29);
+    inv = FIX_MUL(FIX_MUL(r, y, 29), coef->inv_ks_ta_q30, 30);
+    sh = 36 - coef->alpha_shift - sh - k;
+    return (int32_t)((uint32_t)inv << 8 | (uint8_t)sh);
+}
+
+/**
+ * @brief 定点版本的像素辐射量e = v_ir / alpha
+ *
+ * @param coef 指向每帧的补偿系数
+ * @param raw 像素的ram数据
+ * @param subpage 像素所属的子界面
+ * @param offset 有效offset，Q8
+ * @param inv_alpha 由pixel_alpha_inv得到的有效alpha的倒数
+ * @return int32_t e，单位2^8 K^4
+ */
+static inline int32_t pixel_e(struct frame_coef *coef, int16_t raw, int subpage, int32_t offset, int32_t inv_alpha)
+{
+    int32_t v_ir;
+    uint32_t inv = (uint32_t)inv_alpha >> 8;
+    int sh = (int8_t)inv_alpha;
+
+    v_ir = FIX_MUL(raw, coef->kg_e_q24, 16) - offset - coef->cp_tgc_q8[subpage];
+    if (sh >= 0)
+        return (int32_t)(((int64_t)v_ir * inv) >> sh);
+    else
+        return (int32_t)(((int64_t)v_ir * inv) << -sh);
+}
+
+/**
+ * @brief 定点版本的单像素计算，除每帧系数外不使用任何浮点运算
+ *
+ * v_ir为Q8，alpha的单位为2^-(alpha_scale+4)，辐射量(K^4)的单位为2^8，
+ * 与浮点版本相比在-40~300℃内的误差不超过±0.05℃
+ *
+ * @param params 指向校准参数
+ * @param coef 指向每帧的补偿系数
+ * @param raw 像素的ram数据
+ * @param subpage 像素所属的子界面
+ * @param offset 有效offset，Q8
+ * @param inv_alpha 由pixel_alpha_inv得到的有效alpha的倒数
+ * @return ll_mlx90640_temp_t 温度，单位℃，Q6
+ */
+static inline ll_mlx90640_temp_t to_pixel_calculate(struct ll_mlx90640_fixed_params *params,
+                                                    struct frame_coef *coef,
+                                                    int16_t raw,
+                                                    int subpage,
+                                                    int32_t offset,
+                                                    int32_t inv_alpha)
+{
+    int32_t e, to, sx;
+
+    e = pixel_e(coef, raw, subpage, offset, inv_alpha);
+    //Sx/alpha = ks_to2 * (e + Ta_r)^(1/4)
+    sx = root4_q6(e + coef->ta_r_u8) - KELVIN_Q6;
+    sx = (1 << 28) + FIX_MUL(sx, params->ks_to_q30[1], 8);
+    to = root4_q6(div_q28(e, sx) + coef->ta_r_u8) - KELVIN_Q6;
+    return to_range_calculate_fixed(params, coef, e, to);
+}
+#endif
+
+/**
+ * @brief 重新计算缓存中指定行的有效offset和alpha的倒数
+ *
+ * @param cache 指向系数缓存
+ * @param params 指向校准参数
+ * @param coef 指向每帧的补偿系数
+ * @param row 起始行
+ * @param rows 行数
+ */
+static void coef_cache_refresh(struct ll_mlx90640_coef_cache *cache,
+                               struct ll_mlx90640_fixed_params *params,
+                               struct frame_coef *coef,
+                               int row,
+                               int rows)
+{
+    int n;
+
+    for (n = row << 5; n < (row + rows) << 5; n++)
+    {
+        cache->offset[n] = pixel_offset_eff(params, coef, n);
+        cache->inv_alpha[n] = pixel_alpha_inv(params, coef, n);
+    }
+}
+
+/**
+ * @brief 更新系数缓存
+ *
+ * 缓存无效、发射率改变或者Ta、Vdd相对缓存时的值变化超过阈值时全部重新计算，
+ * 否则直接使用缓存，设置了slice_rows时每次还会轮流刷新slice_rows行以跟踪缓慢的漂移
+ *
+ * @param handle 指向ll_mlx90640
+ * @param params 指向校准参数
+ * @param coef 指向每帧的补偿系数
+ */
+static void coef_cache_update(struct ll_mlx90640 *handle,
+                              struct ll_mlx90640_fixed_params *params,
+                              struct frame_coef *coef)
+{
+    struct ll_mlx90640_coef_cache *cache = handle->coef_cache;
+    int rows;
+
+    if (!cache->valid ||
+        cache->emissivity != handle->emissivity ||
+        cache->pattern != coef->chess ||
+        LL_ABS(coef->ta_diff - cache->ta) > cache->ta_threshold ||
+        LL_ABS(coef->v_diff - cache->vdd) > cache->vdd_threshold)
+    {
+        coef_cache_refresh(cache, params, coef, 0, 24);
+        cache->ta = coef->ta_diff;
+        cache->vdd = coef->v_diff;
+        cache->emissivity = handle->emissivity;
+        cache->pattern = coef->chess;
+        cache->cursor = 0;
+        cache->valid = 1;
+        cache->recomputes++;
+        return;
+    }
+
+    cache->hits++;
+    if (!cache->slice_rows)
+        return;
+    //一轮刷新完成后缓存中最旧的系数对应这一轮开始时的Ta、Vdd
+    if (!cache->cursor)
+    {
+        cache->sweep_ta = coef->ta_diff;
+        cache->sweep_vdd = coef->v_diff;
+    }
+    rows = LL_MIN(cache->slice_rows, 24 - cache->cursor);
+    coef_cache_refresh(cache, params, coef, cache->cursor, rows);
+    cache->cursor += rows;
+    if (cache->cursor >= 24)
+    {
+        cache->ta = cache->sweep_ta;
+        cache->vdd = cache->sweep_vdd;
+        cache->cursor = 0;
+    }
+}
+
+/**
+ * @brief 时域滤波，滤波系数随新值与历史值之差自适应，系数的计算只使用整数运算
+ *
+ * @param filter 指向滤波器
+ * @param old 历史值
+ * @param new 新计算的温度
+ * @return ll_mlx90640_temp_t 滤波后的温度
+ */
+static inline ll_mlx90640_temp_t temp_filter(struct ll_mlx90640_filter *filter,
+                                             ll_mlx90640_temp_t old,
+                                             ll_mlx90640_temp_t new)
+{
+#ifdef LL_MLX90640_USING_FIXED_POINT
+    int32_t d = new - old;
+#else
+    int32_t d = (int32_t)((new - old) * (1 << 6));
+#endif
+    uint32_t ad = d < 0 ? -d : d;
+    uint32_t k = filter->k_min;
+
+    if (ad >= filter->motion)
+        return new;
+    if (ad > filter->noise)
+        k += ((ad - filter->noise) * filter->slope) >> 8;
+#ifdef LL_MLX90640_USING_FIXED_POINT
+    return old + ((d * (int32_t)k + (1 << 7)) >> 8);
+#else
+    return old + (new - old) * (int32_t)k * (1.0f / 256);
+#endif
+}
+
+/**
+ * @brief 把一个像素计入统计结果
+ *
+ * @param stats 指向帧统计
+ * @param part 指向子界面的统计结果
+ * @param t 像素温度
+ * @param n 像素序号
+ */
+static inline void stats_add(struct ll_mlx90640_stats *stats,
+                             struct ll_mlx90640_stats_part *part,
+                             ll_mlx90640_temp_t t,
+                             int n)
+{
+    int32_t bin;
+#ifndef LL_MLX90640_USING_FIXED_POINT
+    float b;
+#endif
+
+    if (t < part->min)
+    {
+        part->min = t;
+        part->argmin = n;
+    }
+    if (t > part->max)
+    {
+        part->max = t;
+        part->argmax = n;
+    }
+    part->sum += t;
+    part->count++;
+#ifdef LL_MLX90640_USING_FIXED_POINT
+    bin = t - stats->hist_min;
+    bin = bin > 0 ? (bin * stats->hist_scale) >> 16 : 0;
+#else
+    b = (t - stats->hist_min) * stats->hist_scale;
+    //同时排除NaN
+    bin = !(b > 0) ? 0 : b < LL_MLX90640_HIST_BINS ? (int32_t)b : LL_MLX90640_HIST_BINS;
+#endif
+    part->hist[LL_MIN(bin, LL_MLX90640_HIST_BINS - 1)]++;
+}
+
+/**
+ * @brief 计算像素温度时使用的参数
+ */
+struct to_ctx
+{
+    struct ll_mlx90640_fixed_params *params;
+    struct ll_mlx90640_ram_buf *buf;
+    struct ll_mlx90640_ir_data *data;
+    struct frame_coef *coef;
+    struct ll_mlx90640_coef_cache *cache;
+    struct ll_mlx90640_filter *filter;
+    struct ll_list_node *stats;
+    const uint32_t *mask;
+    uint32_t *stale;
+};
+
+/**
+ * @brief 计算单个像素的温度，同时完成滤波和统计
+ *
+ * @param ctx 指向计算参数
+ * @param n 像素序号
+ * @param subpage 像素所属的子界面，调用时为常量
+ */
+static __LL_ALWAYS_INLINE void to_pixel(const struct to_ctx *ctx, int n, int subpage)
+{
+    ll_mlx90640_coef_t offset, inv_alpha;
+    ll_mlx90640_temp_t to;
+    struct ll_mlx90640_stats *st;
+
+    if (ctx->mask && !(ctx->mask[n >> 5] >> (n & 31) & 1))
+        return;
+    if (ctx->cache)
+    {
+        offset = ctx->cache->offset[n];
+        inv_alpha = ctx->cache->inv_alpha[n];
+    }
+    else
+    {
+        offset = pixel_offset_eff(ctx->params, ctx->coef, n);
+        inv_alpha = pixel_alpha_inv(ctx->params, ctx->coef, n);
+    }
+    to = to_pixel_calculate(ctx->params, ctx->coef, (int16_t)ctx->buf->data[n], subpage, offset, inv_alpha);
+    //历史值已过期的像素直接使用新值
+    if (ctx->stale && ctx->stale[n >> 5] >> (n & 31) & 1)
+        ctx->stale[n >> 5] &= ~(1UL << (n & 31));
+    else if (ctx->filter)
+        to = temp_filter(ctx->filter, ctx->data->temp[n], to);
+    ctx->data->temp[n] = to;
+    if (ctx->stats)
+    {
+        LL_FOR_EACH_LIST_ENTRY(ctx->stats, st, node)
+        {
+            if (st->mask[n >> 5] >> (n & 31) & 1)
+                stats_add(st, &st->part[subpage], to, n);
+        }
+    }
+}
+
+/**
+ * @brief 计算一行中属于子界面的像素，循环按2个像素展开
+ *
+ * @param ctx 指向计算参数
+ * @param row 行号
+ * @param first 第一个像素的列号，调用时为常量
+ * @param step 相邻像素的列距，调用时为常量
+ * @param subpage 子界面号，调用时为常量
+ */
+static __LL_ALWAYS_INLINE void to_row(const struct to_ctx *ctx, int row, int first, int step, int subpage)
+{
+    int n = row << 5, j;
 
-    for (i = 0; i < 32; i++)
+    if (ctx->mask && !ctx->mask[row])
+        return;
+    for (j = first; j < 32; j += 2 * step)
     {
-        for (j = 0; j < 24; j++)
+        to_pixel(ctx, n + j, subpage);
+        to_pixel(ctx, n + j + step, subpage);
+    }
+}
+
+/**
+ * @brief 计算一个子界面的像素，每次处理奇偶两行，使行列的奇偶在编译时确定
+ *
+ * 棋盘模式下偶数行从第subpage列开始、奇数行从第subpage ^ 1列开始，每隔一列；隔行模式下为第subpage行开始的每隔一行
+ *
+ * @param ctx 指向计算参数
+ * @param chess 1 棋盘模式，0 隔行模式，调用时为常量
+ * @param subpage 子界面号，调用时为常量
+ */
+static __LL_ALWAYS_INLINE void to_subpage(const struct to_ctx *ctx, int chess, int subpage)
+{
+    int i;
+
+    for (i = 0; i < 24; i += 2)
+    {
+        if (chess)
         {
-            float compen = (float)(*p_kta++) / (1 << params->kta_scale_1);
-            compen = *p_off++ * (1 + compen * ta_diff);
-            compen *= (1 + read_kv(params, i, j) * v_diff);
-            *dst = *src++ * kgain - compen;
+            to_row(ctx, i, subpage, 2, subpage);
+            to_row(ctx, i + 1, subpage ^ 1, 2, subpage);
         }
+        else
+            to_row(ctx, i + subpage, 0, 1, subpage);
     }
 }
 
+static void to_subpage_interleaved_0(const struct to_ctx *ctx)
+{
+    to_subpage(ctx, 0, 0);
+}
+
+static void to_subpage_interleaved_1(const struct to_ctx *ctx)
+{
+    to_subpage(ctx, 0, 1);
+}
+
+static void to_subpage_chess_0(const struct to_ctx *ctx)
+{
+    to_subpage(ctx, 1, 0);
+}
+
+static void to_subpage_chess_1(const struct to_ctx *ctx)
+{
+    to_subpage(ctx, 1, 1);
+}
+
+//按[读取模式][子界面]特化的计算函数
+static void (*const to_subpage_kernel[2][2])(const struct to_ctx *ctx) = {
+    {to_subpage_interleaved_0, to_subpage_interleaved_1},
+    {to_subpage_chess_0, to_subpage_chess_1},
+};
+
+/**
+ * @brief 计算一帧或一个子界面的像素温度，每次计算只根据读取模式选择一次计算函数
+ *
+ * 整帧时依次计算两个子界面，统计结果分别保存在两个子界面中
+ *
+ * @param params 指向校准参数
+ * @param buf 指向ram数据
+ * @param data 用于保存计算结果，不属于该子界面的像素保持不变
+ * @param coef 指向每帧的补偿系数
+ * @param subpage 子界面号，小于0时计算整帧
+ * @param cache 指向系数缓存，为NULL时逐像素计算有效offset和alpha的倒数
+ * @param filter 指向时域滤波器，为NULL时不滤波
+ * @param stats 指向帧统计的链表头，为NULL时不统计
+ * @param mask 需要计算的像素，每行一个字，为NULL时计算全部像素
+ * @param stale 历史值已过期的像素，计算后清除对应的位，为NULL时没有过期的像素
+ */
+static void to_calculate(struct ll_mlx90640_fixed_params *params,
+                         struct ll_mlx90640_ram_buf *buf,
+                         struct ll_mlx90640_ir_data *data,
+                         struct frame_coef *coef,
+                         int subpage,
+                         struct ll_mlx90640_coef_cache *cache,
+                         struct ll_mlx90640_filter *filter,
+                         struct ll_list_node *stats,
+                         const uint32_t *mask,
+                         uint32_t *stale)
+{
+    const struct to_ctx ctx = {
+        .params = params,
+        .buf = buf,
+        .data = data,
+        .coef = coef,
+        .cache = cache,
+        .filter = filter,
+        .stats = stats,
+        .mask = mask,
+        .stale = stale,
+    };
+
+    if (subpage < 0)
+    {
+        to_subpage_kernel[coef->chess][0](&ctx);
+        to_subpage_kernel[coef->chess][1](&ctx);
+    }
+    else
+        to_subpage_kernel[coef->chess][subpage](&ctx);
+}
+
+/**
+ * @brief 用相邻像素的平均值替换坏点和异常点，只处理列表中的像素
+ *
+ * @param params 指向校准参数
+ * @param data 指向计算得到的温度
+ */
+static void bad_pixel_fix(struct ll_mlx90640_fixed_params *params, struct ll_mlx90640_ir_data *data)
+{
+    int k, i;
+
+    for (k = 0; k < params->bad_pixel_numb; k++)
+    {
+#ifdef LL_MLX90640_USING_FIXED_POINT
+        int32_t sum = 0;
+#else
+        float sum = 0;
+#endif
+        if (!params->bad_pixel_nbr_numb[k])
+            continue;
+        for (i = 0; i < params->bad_pixel_nbr_numb[k]; i++)
+            sum += data->temp[params->bad_pixel_nbr[k][i]];
+        data->temp[params->bad_pixel[k]] = sum / params->bad_pixel_nbr_numb[k];
+    }
+}
+
+static void stats_part_reset(struct ll_mlx90640_stats_part *part)
+{
+#ifdef LL_MLX90640_USING_FIXED_POINT
+    part->min = INT16_MAX;
+    part->max = INT16_MIN;
+#else
+    part->min = FLT_MAX;
+    part->max = -FLT_MAX;
+#endif
+    part->count = 0;
+    part->sum = 0;
+    memset(part->hist, 0, sizeof(part->hist));
+}
+
+/**
+ * @brief 开始统计，清除本次计算的子界面的统计结果
+ *
+ * @param handle 指向ll_mlx90640
+ * @param subpage 子界面号，小于0时为整帧
+ * @return struct ll_list_node* 帧统计的链表头，没有帧统计时为NULL
+ */
+static struct ll_list_node *stats_begin(struct ll_mlx90640 *handle, int subpage)
+{
+    struct ll_mlx90640_stats *st;
+
+    if (ll_list_is_empty(&handle->stats_head))
+        return NULL;
+    LL_FOR_EACH_LIST_ENTRY(&handle->stats_head, st, node)
+    {
+        stats_part_reset(&st->part[subpage < 0 ? 0 : subpage]);
+        if (subpage < 0)
+            stats_part_reset(&st->part[1]);
+    }
+    return &handle->stats_head;
+}
+
+/**
+ * @brief 完成统计，合并两个子界面和坏点的结果
+ *
+ * 每次计算都会重新插值所有坏点，因此坏点不计入子界面的结果，而是每次单独统计
+ *
+ * @param handle 指向ll_mlx90640
+ * @param params 指向校准参数
+ * @param data 指向计算得到的温度
+ */
+static void stats_end(struct ll_mlx90640 *handle,
+                      struct ll_mlx90640_fixed_params *params,
+                      struct ll_mlx90640_ir_data *data)
+{
+    struct ll_mlx90640_stats *st;
+    struct ll_mlx90640_stats_part bad;
+    struct ll_mlx90640_stats_part *part[3] = {NULL, NULL, &bad};
+    struct ll_mlx90640_frame_stats *frame;
+    int k, i;
+#ifdef LL_MLX90640_USING_FIXED_POINT
+    int32_t sum;
+#else
+    float sum;
+#endif
+
+    LL_FOR_EACH_LIST_ENTRY(&handle->stats_head, st, node)
+    {
+        stats_part_reset(&bad);
+        for (k = 0; k < params->bad_pixel_numb; k++)
+        {
+            if (st->bad_roi >> k & 1 && params->bad_pixel_nbr_numb[k])
+                stats_add(st, &bad, data->temp[params->bad_pixel[k]], params->bad_pixel[k]);
+        }
+
+        part[0] = &st->part[0];
+        part[1] = &st->part[1];
+        frame = &st->frame;
+        frame->min = bad.min;
+        frame->max = bad.max;
+        frame->argmin = bad.argmin;
+        frame->argmax = bad.argmax;
+        frame->count = 0;
+        sum = 0;
+        memset(frame->hist, 0, sizeof(frame->hist));
+        for (k = 0; k < 3; k++)
+        {
+            if (part[k]->min < frame->min)
+            {
+                frame->min = part[k]->min;
+                frame->argmin = part[k]->argmin;
+            }
+            if (part[k]->max > frame->max)
+            {
+                frame->max = part[k]->max;
+                frame->argmax = part[k]->argmax;
+            }
+            frame->count += part[k]->count;
+            sum += part[k]->sum;
+            for (i = 0; i < LL_MLX90640_HIST_BINS; i++)
+                frame->hist[i] += part[k]->hist[i];
+        }
+        if (!frame->count)
+            frame->mean = 0;
+        else
+#ifdef LL_MLX90640_USING_FIXED_POINT
+            frame->mean = (sum + (sum < 0 ? -frame->count : frame->count) / 2) / frame->count;
+#else
+            frame->mean = sum / frame->count;
+#endif
+    }
+}
+
+/**
+ * @brief 获取懒计算模式下本次需要计算的像素
+ *
+ * 在lazy_mask的基础上加入所有帧统计的像素，以及范围内坏点插值所用的相邻像素；
+ * 本次不计算的像素标记为历史值过期，之后重新加入时第一次计算不滤波
+ *
+ * @param handle 指向ll_mlx90640
+ * @param params 指向校准参数
+ * @param mask 用于保存结果，每行一个字
+ * @return const uint32_t* 没有开启懒计算模式时为NULL，否则为mask
+ */
+static const uint32_t *lazy_mask_get(struct ll_mlx90640 *handle,
+                                     struct ll_mlx90640_fixed_params *params,
+                                     uint32_t *mask)
+{
+    struct ll_mlx90640_stats *st;
+    uint8_t bad = 0;
+    int i, k, n;
+
+    if (!handle->lazy)
+        return NULL;
+    memcpy(mask, handle->lazy_mask, sizeof(handle->lazy_mask));
+    LL_FOR_EACH_LIST_ENTRY(&handle->stats_head, st, node)
+    {
+        for (i = 0; i < 24; i++)
+            mask[i] |= st->mask[i];
+        bad |= st->bad_roi;
+    }
+    for (k = 0; k < params->bad_pixel_numb; k++)
+    {
+        n = params->bad_pixel[k];
+        if (!(bad >> k & 1) && !(handle->lazy_mask[n >> 5] >> (n & 31) & 1))
+            continue;
+        for (i = 0; i < params->bad_pixel_nbr_numb[k]; i++)
+        {
+            n = params->bad_pixel_nbr[k][i];
+            mask[n >> 5] |= 1UL << (n & 31);
+        }
+    }
+    for (i = 0; i < 24; i++)
+        handle->lazy_stale[i] |= ~mask[i];
+    return mask;
+}
+
+/**
+ * @brief 获取本次计算使用的滤波器，子界面还没有历史数据时不滤波
+ *
+ * @param handle 指向ll_mlx90640
+ * @param mask 本次计算的子界面，bit0、bit1分别对应子界面0、1
+ * @return struct ll_mlx90640_filter* 滤波器，不需要滤波时为NULL
+ */
+static struct ll_mlx90640_filter *filter_get(struct ll_mlx90640 *handle, uint8_t mask)
+{
+    struct ll_mlx90640_filter *filter = handle->filter;
+
+    if (!filter)
+        return NULL;
+    if ((filter->primed & mask) != mask)
+    {
+        filter->primed |= mask;
+        return NULL;
+    }
+    return filter;
+}
+
+/**
+ * @brief 根据ram数据计算每个像素的温度，ram数据由ll_mlx90640_read_raw_data或采集服务获取
+ *
+ * @param handle 指向ll_mlx90640
+ * @param params 指向校准参数
+ * @param buf 指向ram数据
+ * @param data 用于保存计算得到的温度，单位℃
+ * @return int 成功返回0，失败返回一个负数
+ */
 int ll_mlx90640_calculate_temp(struct ll_mlx90640 *handle,
                                struct ll_mlx90640_fixed_params *params,
                                struct ll_mlx90640_ram_buf *buf,
                                struct ll_mlx90640_ir_data *data)
 {
-    float v_diff;
-    float ta_diff;
-    float kgain;
+    struct frame_coef coef;
+    struct ll_list_node *stats;
+    uint32_t mask[24];
+
+    LL_ASSERT(handle && params && buf && data);
+    frame_coef_calculate(handle, params, buf, &coef);
+    if (handle->coef_cache)
+        coef_cache_update(handle, params, &coef);
+    stats = stats_begin(handle, -1);
+    to_calculate(params,
+                 buf,
+                 data,
+                 &coef,
+                 -1,
+                 handle->coef_cache,
+                 filter_get(handle, 0x3),
+                 stats,
+                 lazy_mask_get(handle, params, mask),
+                 handle->lazy ? handle->lazy_stale : NULL);
+    bad_pixel_fix(params, data);
+    if (stats)
+        stats_end(handle, params, data);
+
+    return 0;
+}
+
+/**
+ * @brief 获取ram数据测量时的读取模式，模式可能在测量之后被修改，处理数据时应以此为准
+ *
+ * @param buf 指向ram数据
+ * @return enum ll_mlx90640_pattern 读取模式
+ */
+enum ll_mlx90640_pattern ll_mlx90640_get_pattern(const struct ll_mlx90640_ram_buf *buf)
+{
+    LL_ASSERT(buf);
+    return buf->ctrl & READING_PATTERN_BIT ? LL_MLX90640_PATTERN_CHESS : LL_MLX90640_PATTERN_INTERLEAVED;
+}
+
+/**
+ * @brief 只计算刚测量完成的子界面的像素温度，并合并到data中
+ *
+ * 每个子界面只需计算一半的像素，data需要在两次调用之间保持
+ *
+ * @param handle 指向ll_mlx90640
+ * @param params 指向校准参数
+ * @param buf 指向ram数据
+ * @param subpage 子界面号，由ll_mlx90640_acq_wait返回
+ * @param data 用于保存计算得到的温度，单位℃
+ * @return int 成功返回0，失败返回一个负数
+ */
+int ll_mlx90640_calculate_subpage(struct ll_mlx90640 *handle,
+                                  struct ll_mlx90640_fixed_params *params,
+                                  struct ll_mlx90640_ram_buf *buf,
+                                  int subpage,
+                                  struct ll_mlx90640_ir_data *data)
+{
+    struct frame_coef coef;
+    struct ll_list_node *stats;
+    uint32_t mask[24];
+
+    LL_ASSERT(handle && params && buf && data);
+    if (subpage < 0 || subpage > 1)
+        return -EINVAL;
+    frame_coef_calculate(handle, params, buf, &coef);
+    if (handle->coef_cache)
+        coef_cache_update(handle, params, &coef);
+    stats = stats_begin(handle, subpage);
+    to_calculate(params,
+                 buf,
+                 data,
+                 &coef,
+                 subpage,
+                 handle->coef_cache,
+                 filter_get(handle, 1 << subpage),
+                 stats,
+                 lazy_mask_get(handle, params, mask),
+                 handle->lazy ? handle->lazy_stale : NULL);
+    bad_pixel_fix(params, data);
+    if (stats)
+        stats_end(handle, params, data);
+
+    return 0;
+}
+
+#define PALETTE_SEGMENTS 16 //温度范围等分的段数，段内索引与e成线性关系
 
-    while (ll_mlx90640_read_raw_data(handle, buf))
+/**
+ * @brief 把温度范围换算为e的分段门限，每帧计算一次
+ */
+struct palette_map
+{
+    ll_mlx90640_coef_t e[PALETTE_SEGMENTS + 1]; //各分段起点的e
+#ifdef LL_MLX90640_USING_FIXED_POINT
+    uint32_t slope[PALETTE_SEGMENTS]; //(段内的索引数 << 32) / 段内e的增量
+#else
+    float slope[PALETTE_SEGMENTS];
+#endif
+};
+
+/**
+ * @brief 计算温度范围对应的分段门限
+ *
+ * 由To的计算公式反推：e = (To^4 - Ta_r) * alpha_corr_range * (1 + ks_to * (To - ct))，To为单调函数
+ *
+ * @param params 指向校准参数
+ * @param coef 指向每帧的补偿系数
+ * @param t_min 索引0对应的温度
+ * @param t_max 索引255对应的温度
+ * @param map 用于保存结果
+ */
+static void palette_map_calculate(struct ll_mlx90640_fixed_params *params,
+                                  struct frame_coef *coef,
+                                  float t_min,
+                                  float t_max,
+                                  struct palette_map *map)
+{
+    int k, r;
+    float t, tk, e;
+    ll_mlx90640_coef_t d;
+
+    for (k = 0; k <= PALETTE_SEGMENTS; k++)
     {
+        t = t_min + (t_max - t_min) * k / PALETTE_SEGMENTS;
+        for (r = 3; r > 0 && t < params->ct[r]; r--)
+            ;
+        tk = t + 273.15f;
+        tk *= tk;
+        tk *= tk;
+        e = (tk - coef->ta_r) * params->alpha_corr_range[r] * (1 + params->ks_to[r] * (t - params->ct[r]));
+#ifdef LL_MLX90640_USING_FIXED_POINT
+        map->e[k] = lroundf(ldexpf(e, -8));
+#else
+        map->e[k] = e;
+#endif
     }
+    for (k = 0; k < PALETTE_SEGMENTS; k++)
+    {
+        d = map->e[k + 1] - map->e[k];
+#ifdef LL_MLX90640_USING_FIXED_POINT
+        //保证段内索引小于256 / PALETTE_SEGMENTS且斜率不溢出
+        d = LL_MAX(d, 256 / PALETTE_SEGMENTS + 1);
+        map->slope[k] = (uint32_t)(((uint64_t)(256 / PALETTE_SEGMENTS) << 32) / (uint32_t)d);
+#else
+        map->slope[k] = d > 0 ? (256 / PALETTE_SEGMENTS) / d : 0;
+#endif
+    }
+}
 
-    v_diff = vdd_diff_calculate(params, buf);
-    LL_INFO("vdd_diff %.3f", v_diff);
-    ta_diff = ta_diff_calculate(params, buf, v_diff);
-    LL_INFO("ta_diff %.3f", ta_diff);
-    kgain = kgain_calculate(params, buf);
-    LL_INFO("kgain %f", kgain);
-    ir_data_compensation(params, buf, data, kgain, ta_diff, v_diff);
+/**
+ * @brief 把e映射为调色板索引，只需要比较和一次乘法
+ *
+ * @param map 指向分段门限
+ * @param e 像素的e
+ * @return uint8_t 调色板索引
+ */
+static inline uint8_t palette_index(const struct palette_map *map, ll_mlx90640_coef_t e)
+{
+    int k = 0, h;
+
+    //同时排除NaN
+    if (!(e > map->e[0]))
+        return 0;
+    if (e >= map->e[PALETTE_SEGMENTS])
+        return 255;
+    for (h = PALETTE_SEGMENTS / 2; h; h >>= 1)
+    {
+        if (e >= map->e[k + h])
+            k += h;
+    }
+#ifdef LL_MLX90640_USING_FIXED_POINT
+    return k * (256 / PALETTE_SEGMENTS) + (uint32_t)(((uint64_t)(uint32_t)(e - map->e[k]) * map->slope[k]) >> 32);
+#else
+    return LL_MIN(k * (256 / PALETTE_SEGMENTS) + (int)((e - map->e[k]) * map->slope[k]), 255);
+#endif
+}
+
+/**
+ * @brief 只为显示计算调色板索引，不计算温度
+ *
+ * 把温度范围换算为补偿后辐射量的门限，每个像素只需计算有效offset和alpha之后的线性部分，
+ * 省去开方、除法和温度区间修正，不经过时域滤波，也不更新帧统计；
+ * 需要温度时对同一个ram数据调用ll_mlx90640_calculate_subpage(可以配合ll_mlx90640_set_lazy只计算需要的像素)。
+ * 与由浮点版本的温度计算的索引相比误差不超过1
+ *
+ * @param handle 指向ll_mlx90640
+ * @param params 指向校准参数
+ * @param buf 指向ram数据
+ * @param subpage 子界面号，由ll_mlx90640_acq_wait返回，小于0时计算整帧
+ * @param t_min 索引0对应的温度(℃)，更低的温度也为0
+ * @param t_max 索引255对应的温度(℃)，更高的温度也为255
+ * @param data 用于保存调色板索引，不属于该子界面的像素保持不变
+ * @return int 成功返回0，失败返回一个负数
+ */
+int ll_mlx90640_calculate_palette(struct ll_mlx90640 *handle,
+                                  struct ll_mlx90640_fixed_params *params,
+                                  struct ll_mlx90640_ram_buf *buf,
+                                  int subpage,
+                                  float t_min,
+                                  float t_max,
+                                  struct ll_mlx90640_palette_data *data)
+{
+    struct frame_coef coef;
+    struct palette_map map;
+    struct ll_mlx90640_coef_cache *cache;
+    ll_mlx90640_coef_t offset, inv_alpha;
+    int i, j, n, k, sum, step;
+
+    LL_ASSERT(handle && params && buf && data);
+    cache = handle->coef_cache;
+    if (subpage > 1 || !(t_max > t_min))
+        return -EINVAL;
+    frame_coef_calculate(handle, params, buf, &coef);
+    if (cache)
+        coef_cache_update(handle, params, &coef);
+    palette_map_calculate(params, &coef, t_min, t_max, &map);
+    step = subpage < 0 || !coef.chess ? 1 : 2;
+    for (i = 0; i < 24; i++)
+    {
+        if (subpage >= 0 && !coef.chess && (i & 1) != subpage)
+            continue;
+        for (j = step == 1 ? 0 : (i ^ subpage) & 1; j < 32; j += step)
+        {
+            n = (i << 5) + j;
+            if (cache)
+            {
+                offset = cache->offset[n];
+                inv_alpha = cache->inv_alpha[n];
+            }
+            else
+            {
+                offset = pixel_offset_eff(params, &coef, n);
+                inv_alpha = pixel_alpha_inv(params, &coef, n);
+            }
+            data->index[n] = palette_index(&map,
+                                           pixel_e(&coef,
+                                                   (int16_t)buf->data[n],
+                                                   pixel_subpage(&coef, n),
+                                                   offset,
+                                                   inv_alpha));
+        }
+    }
+    for (k = 0; k < params->bad_pixel_numb; k++)
+    {
+        if (!params->bad_pixel_nbr_numb[k])
+            continue;
+        sum = 0;
+        for (i = 0; i < params->bad_pixel_nbr_numb[k]; i++)
+            sum += data->index[params->bad_pixel_nbr[k][i]];
+        data->index[params->bad_pixel[k]] = sum / params->bad_pixel_nbr_numb[k];
+    }
 
     return 0;
-}
\ No newline at end of file
+}
+
+/**
+ * @brief 设置物体的发射率
+ *
+ * @param handle 指向ll_mlx90640
+ * @param emissivity 发射率，范围(0, 1]
+ */
+void ll_mlx90640_set_emissivity(struct ll_mlx90640 *handle, float emissivity)
+{
+    LL_ASSERT(handle && emissivity > 0 && emissivity <= 1);
+    handle->emissivity = emissivity;
+}
+
+/**
+ * @brief 初始化系数缓存
+ *
+ * @param cache 指向系数缓存
+ * @param ta_threshold Ta变化超过该值(℃)时全部重新计算
+ * @param vdd_threshold Vdd变化超过该值(V)时全部重新计算
+ * @param slice_rows 每次轮流刷新的行数，为0时只在超过阈值时刷新
+ */
+void ll_mlx90640_coef_cache_init(struct ll_mlx90640_coef_cache *cache,
+                                 float ta_threshold,
+                                 float vdd_threshold,
+                                 uint8_t slice_rows)
+{
+    LL_ASSERT(cache && ta_threshold >= 0 && vdd_threshold >= 0 && slice_rows <= 24);
+    cache->ta_threshold = ta_threshold;
+    cache->vdd_threshold = vdd_threshold;
+    cache->slice_rows = slice_rows;
+    cache->cursor = 0;
+    cache->valid = 0;
+    cache->hits = 0;
+    cache->recomputes = 0;
+}
+
+/**
+ * @brief 设置计算温度时使用的系数缓存
+ *
+ * @param handle 指向ll_mlx90640
+ * @param cache 指向由ll_mlx90640_coef_cache_init初始化的系数缓存，为NULL时不使用缓存
+ */
+void ll_mlx90640_set_coef_cache(struct ll_mlx90640 *handle, struct ll_mlx90640_coef_cache *cache)
+{
+    LL_ASSERT(handle);
+    if (cache)
+        cache->valid = 0;
+    handle->coef_cache = cache;
+}
+
+/**
+ * @brief 初始化时域滤波器
+ *
+ * k_min越小静止时的噪声越小，滤波后噪声的方差约为原来的k_min / (512 - k_min)
+ *
+ * @param filter 指向滤波器
+ * @param k_min 最小滤波系数，单位1/256，为0时静止像素不再更新
+ * @param noise 噪声门限(℃)，变化量不超过该值时按k_min滤波
+ * @param motion 运动门限(℃)，变化量超过该值时不滤波
+ */
+void ll_mlx90640_filter_init(struct ll_mlx90640_filter *filter, uint8_t k_min, float noise, float motion)
+{
+    LL_ASSERT(filter && noise >= 0 && motion > noise && motion < 512);
+    filter->noise = (uint16_t)(noise * (1 << 6));
+    filter->motion = (uint16_t)(motion * (1 << 6));
+    if (filter->motion <= filter->noise)
+        filter->motion = filter->noise + 1;
+    filter->slope = (uint16_t)LL_MIN(((256 - k_min) << 8) / (filter->motion - filter->noise), 0xffff);
+    filter->k_min = k_min;
+    filter->primed = 0;
+}
+
+/**
+ * @brief 初始化帧统计
+ *
+ * 坏点和异常点以插值后的温度计入统计，直方图把[hist_min, hist_max)等分为LL_MLX90640_HIST_BINS个区间，
+ * 超出范围的温度计入两端的区间
+ *
+ * @param stats 指向帧统计
+ * @param params 指向校准参数，用于获取坏点
+ * @param roi 参与统计的像素，每行一个字，bit n对应第n列，为NULL时统计所有像素
+ * @param hist_min 直方图下限(℃)
+ * @param hist_max 直方图上限(℃)，与下限至少相差1℃
+ */
+void ll_mlx90640_stats_init(struct ll_mlx90640_stats *stats,
+                            struct ll_mlx90640_fixed_params *params,
+                            const uint32_t *roi,
+                            float hist_min,
+                            float hist_max)
+{
+    int i, k, n;
+
+    LL_ASSERT(stats && params && hist_max - hist_min >= 1);
+    for (i = 0; i < 24; i++)
+        stats->mask[i] = roi ? roi[i] : 0xffffffff;
+    stats->bad_roi = 0;
+    for (k = 0; k < params->bad_pixel_numb; k++)
+    {
+        n = params->bad_pixel[k];
+        if (stats->mask[n >> 5] >> (n & 31) & 1)
+            stats->bad_roi |= 1 << k;
+        stats->mask[n >> 5] &= ~(1UL << (n & 31));
+    }
+    stats->hist_min = LL_MLX90640_TEMP_FROM_FLOAT(hist_min);
+#ifdef LL_MLX90640_USING_FIXED_POINT
+    stats->hist_scale = lroundf(ldexpf(LL_MLX90640_HIST_BINS / (hist_max - hist_min), 16 - LL_MLX90640_TEMP_FRAC_BITS));
+#else
+    stats->hist_scale = LL_MLX90640_HIST_BINS / (hist_max - hist_min);
+#endif
+    stats_part_reset(&stats->part[0]);
+    stats_part_reset(&stats->part[1]);
+    memset(&stats->frame, 0, sizeof(struct ll_mlx90640_frame_stats));
+}
+
+/**
+ * @brief 添加帧统计，之后每次计算温度时同时更新stats->frame
+ *
+ * @param handle 指向ll_mlx90640
+ * @param stats 指向由ll_mlx90640_stats_init初始化的帧统计
+ */
+void ll_mlx90640_add_stats(struct ll_mlx90640 *handle, struct ll_mlx90640_stats *stats)
+{
+    LL_ASSERT(handle && stats);
+    ll_list_add_tail(&handle->stats_head, &stats->node);
+}
+
+/**
+ * @brief 移除帧统计
+ *
+ * @param handle 指向ll_mlx90640
+ * @param stats 指向帧统计
+ */
+void ll_mlx90640_remove_stats(struct ll_mlx90640 *handle, struct ll_mlx90640_stats *stats)
+{
+    LL_ASSERT(handle && stats);
+    ll_list_delete(&stats->node);
+}
+
+/**
+ * @brief 设置懒计算模式，只计算需要的像素，其余像素保持上次计算的值
+ *
+ * 只使用区域测量或报警区域时(例如关闭显示后)使用，帧统计的像素总是会被计算；
+ * 需要整帧数据时(例如打开显示)以NULL调用切换回整帧计算。
+ * 像素(包括mask或帧统计改变后)重新开始计算时，第一次的结果不经过时域滤波，不使用过期的历史值。
+ * 需要在计算温度的线程中调用
+ *
+ * @param handle 指向ll_mlx90640
+ * @param mask 需要计算的像素，每行一个字，bit n对应第n列，为NULL时计算整帧
+ */
+void ll_mlx90640_set_lazy(struct ll_mlx90640 *handle, const uint32_t *mask)
+{
+    LL_ASSERT(handle);
+    if (mask)
+    {
+        //懒计算模式下逐像素记录过期的历史值
+        if (!handle->lazy)
+            memset(handle->lazy_stale, 0, sizeof(handle->lazy_stale));
+        memcpy(handle->lazy_mask, mask, sizeof(handle->lazy_mask));
+        handle->lazy = 1;
+    }
+    else if (handle->lazy)
+    {
+        handle->lazy = 0;
+        //之前没有计算的像素的历史值已经过期
+        if (handle->filter)
+            handle->filter->primed = 0;
+    }
+}
+
+/**
+ * @brief 设置计算温度时使用的时域滤波器，滤波在计算温度的同时完成，不额外遍历数据
+ *
+ * 只作用于ll_mlx90640_calculate_subpage计算的像素(lazy模式下只有需要的像素)，
+ * ll_mlx90640_calculate_palette的调色板索引不经过滤波
+ *
+ * @param handle 指向ll_mlx90640
+ * @param filter 指向由ll_mlx90640_filter_init初始化的滤波器，为NULL时不滤波
+ */
+void ll_mlx90640_set_filter(struct ll_mlx90640 *handle, struct ll_mlx90640_filter *filter)
+{
+    LL_ASSERT(handle);
+    if (filter)
+        filter->primed = 0;
+    handle->filter = filter;
+}
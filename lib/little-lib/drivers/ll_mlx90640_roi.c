@@ -0,0 +1,315 @@
+/**
+ * @file ll_mlx90640_roi.c
+ * @author salalei (1028609078@qq.com)
+ * @brief mlx90640的感兴趣区域测量
+ * @version 0.1
+ * @date 2022-03-20
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+#include "ll_mlx90640_roi.h"
+#include "ll_assert.h"
+
+#include <float.h>
+#include <string.h>
+
+/**
+ * @brief 判断像素是否属于区域，调用者保证像素在外接矩形内
+ */
+static inline bool roi_contain(const struct ll_mlx90640_roi *roi, int row, int col)
+{
+    return !roi->mask || (roi->mask[row] >> col & 1);
+}
+
+/**
+ * @brief 计算区域在两种读取模式下包含的子界面
+ *
+ * @param roi 指向区域
+ */
+static void roi_touch_calculate(struct ll_mlx90640_roi *roi)
+{
+    int i, j;
+
+    roi->touch[LL_MLX90640_PATTERN_INTERLEAVED] = 0;
+    roi->touch[LL_MLX90640_PATTERN_CHESS] = 0;
+    for (i = roi->y; i < roi->y + roi->h; i++)
+    {
+        for (j = roi->x; j < roi->x + roi->w; j++)
+        {
+            if (!roi_contain(roi, i, j))
+                continue;
+            roi->touch[LL_MLX90640_PATTERN_INTERLEAVED] |= 1 << (i & 1);
+            roi->touch[LL_MLX90640_PATTERN_CHESS] |= 1 << ((i ^ j) & 1);
+        }
+    }
+}
+
+/**
+ * @brief 重新累加区域内一个子界面的像素
+ *
+ * @param roi 指向区域
+ * @param data 指向温度数据
+ * @param subpage 子界面号
+ * @param pattern 读取模式
+ */
+static void roi_part_calculate(struct ll_mlx90640_roi *roi,
+                               const struct ll_mlx90640_ir_data *data,
+                               int subpage,
+                               enum ll_mlx90640_pattern pattern)
+{
+    struct ll_mlx90640_roi_part *part = &roi->part[subpage];
+    int i, j, n, step;
+    ll_mlx90640_temp_t t;
+#ifdef LL_MLX90640_USING_FIXED_POINT
+    int32_t d;
+#else
+    float d;
+#endif
+
+    memset(part, 0, sizeof(struct ll_mlx90640_roi_part));
+#ifdef LL_MLX90640_USING_FIXED_POINT
+    part->max = INT16_MIN;
+#else
+    part->max = -FLT_MAX;
+#endif
+    step = pattern == LL_MLX90640_PATTERN_CHESS ? 2 : 1;
+    for (i = roi->y; i < roi->y + roi->h; i++)
+    {
+        if (pattern != LL_MLX90640_PATTERN_CHESS && (i & 1) != subpage)
+            continue;
+        j = roi->x;
+        if (pattern == LL_MLX90640_PATTERN_CHESS)
+            j += (i ^ j ^ subpage) & 1;
+        for (; j < roi->x + roi->w; j += step)
+        {
+            if (!roi_contain(roi, i, j))
+                continue;
+            n = (i << 5) + j;
+            t = data->temp[n];
+            part->sum += t;
+            part->count++;
+            if (t > part->max)
+            {
+                part->max = t;
+                part->argmax = n;
+            }
+            d = t - roi->threshold;
+            if (d > 0)
+            {
+                part->area++;
+                part->w += d;
+                part->wx += d * j;
+                part->wy += d * i;
+            }
+        }
+    }
+}
+
+/**
+ * @brief 合并两个子界面的累加结果
+ *
+ * @param roi 指向区域
+ * @param data 指向温度数据
+ */
+static void roi_merge(struct ll_mlx90640_roi *roi, const struct ll_mlx90640_ir_data *data)
+{
+    struct ll_mlx90640_roi_part *p0 = &roi->part[0], *p1 = &roi->part[1];
+    struct ll_mlx90640_roi_result *res = &roi->result;
+#ifdef LL_MLX90640_USING_FIXED_POINT
+    int32_t sum = p0->sum + p1->sum;
+    int32_t w = p0->w + p1->w;
+#else
+    float w = p0->w + p1->w;
+#endif
+
+    res->spot = data->temp[((roi->y + roi->h / 2) << 5) + roi->x + roi->w / 2];
+    res->count = p0->count + p1->count;
+    res->area = p0->area + p1->area;
+    if (p1->max > p0->max)
+    {
+        res->max = p1->max;
+        res->argmax = p1->argmax;
+    }
+    else
+    {
+        res->max = p0->max;
+        res->argmax = p0->argmax;
+    }
+#ifdef LL_MLX90640_USING_FIXED_POINT
+    res->mean = res->count ? (sum + (sum < 0 ? -res->count : res->count) / 2) / res->count : 0;
+    if (w > 0)
+    {
+        res->cx = (uint16_t)((((int64_t)(p0->wx + p1->wx) << 8) + w / 2) / w);
+        res->cy = (uint16_t)((((int64_t)(p0->wy + p1->wy) << 8) + w / 2) / w);
+        return;
+    }
+#else
+    res->mean = res->count ? (p0->sum + p1->sum) / res->count : 0;
+    if (w > 0)
+    {
+        res->cx = (uint16_t)((p0->wx + p1->wx) * 256 / w + 0.5f);
+        res->cy = (uint16_t)((p0->wy + p1->wy) * 256 / w + 0.5f);
+        return;
+    }
+#endif
+    res->cx = (res->argmax & 31) << 8;
+    res->cy = (res->argmax >> 5) << 8;
+}
+
+/**
+ * @brief 初始化一组区域
+ *
+ * @param set 指向区域组
+ */
+void ll_mlx90640_roi_init(struct ll_mlx90640_roi_set *set)
+{
+    LL_ASSERT(set);
+    set->numb = 0;
+}
+
+/**
+ * @brief 添加一个区域
+ *
+ * @param set 指向区域组
+ * @param x 外接矩形左上角的列
+ * @param y 外接矩形左上角的行
+ * @param w 外接矩形的宽
+ * @param h 外接矩形的高
+ * @param mask 区域的掩码，为NULL时为整个矩形
+ * @param threshold 面积和质心的温度门限(℃)
+ * @return int 成功返回区域的序号，失败返回一个负数
+ */
+static int roi_add(struct ll_mlx90640_roi_set *set,
+                   uint8_t x,
+                   uint8_t y,
+                   uint8_t w,
+                   uint8_t h,
+                   const uint32_t *mask,
+                   float threshold)
+{
+    struct ll_mlx90640_roi *roi;
+
+    if (set->numb >= LL_MLX90640_ROI_MAX)
+        return -ENOSPC;
+    roi = &set->roi[set->numb];
+    memset(roi, 0, sizeof(struct ll_mlx90640_roi));
+    roi->x = x;
+    roi->y = y;
+    roi->w = w;
+    roi->h = h;
+    roi->mask = mask;
+    roi->threshold = LL_MLX90640_TEMP_FROM_FLOAT(threshold);
+    roi_touch_calculate(roi);
+    return set->numb++;
+}
+
+/**
+ * @brief 添加一个矩形区域
+ *
+ * @param set 指向区域组
+ * @param x 左上角的列
+ * @param y 左上角的行
+ * @param w 宽
+ * @param h 高
+ * @param threshold 面积和质心的温度门限(℃)
+ * @return int 成功返回区域的序号，失败返回一个负数
+ */
+int ll_mlx90640_roi_add_rect(struct ll_mlx90640_roi_set *set,
+                             uint8_t x,
+                             uint8_t y,
+                             uint8_t w,
+                             uint8_t h,
+                             float threshold)
+{
+    LL_ASSERT(set);
+    if (!w || !h || x + w > 32 || y + h > 24)
+        return -EINVAL;
+    return roi_add(set, x, y, w, h, NULL, threshold);
+}
+
+/**
+ * @brief 添加一个任意形状的区域，掩码需要在区域使用期间保持有效
+ *
+ * @param set 指向区域组
+ * @param mask 区域的掩码，每行一个字，bit n对应第n列
+ * @param threshold 面积和质心的温度门限(℃)
+ * @return int 成功返回区域的序号，失败返回一个负数
+ */
+int ll_mlx90640_roi_add_mask(struct ll_mlx90640_roi_set *set, const uint32_t *mask, float threshold)
+{
+    int i, x0 = 32, x1 = -1, y0 = 24, y1 = -1;
+
+    LL_ASSERT(set && mask);
+    for (i = 0; i < 24; i++)
+    {
+        if (!mask[i])
+            continue;
+        if (y0 > i)
+            y0 = i;
+        y1 = i;
+        x0 = LL_MIN(x0, __builtin_ctz(mask[i]));
+        x1 = LL_MAX(x1, 31 - __builtin_clz(mask[i]));
+    }
+    if (y1 < 0)
+        return -EINVAL;
+    return roi_add(set, x0, y0, x1 - x0 + 1, y1 - y0 + 1, mask, threshold);
+}
+
+/**
+ * @brief 用新计算的温度更新区域的测量结果，只重新累加包含该子界面像素的区域
+ *
+ * 在ll_mlx90640_calculate_subpage或ll_mlx90640_calculate_temp之后调用，
+ * 结果保存在set->roi[n].result中
+ *
+ * @param set 指向区域组
+ * @param data 指向温度数据
+ * @param subpage 刚计算的子界面号，小于0时更新整帧
+ * @param pattern 测量时的读取模式
+ */
+void ll_mlx90640_roi_update(struct ll_mlx90640_roi_set *set,
+                            const struct ll_mlx90640_ir_data *data,
+                            int subpage,
+                            enum ll_mlx90640_pattern pattern)
+{
+    struct ll_mlx90640_roi *roi;
+    int i;
+
+    LL_ASSERT(set && data && subpage < 2 && pattern <= LL_MLX90640_PATTERN_CHESS);
+    for (i = 0; i < set->numb; i++)
+    {
+        roi = &set->roi[i];
+        if (subpage < 0)
+        {
+            roi_part_calculate(roi, data, 0, pattern);
+            roi_part_calculate(roi, data, 1, pattern);
+        }
+        else if (roi->touch[pattern] >> subpage & 1)
+            roi_part_calculate(roi, data, subpage, pattern);
+        else
+            continue;
+        roi_merge(roi, data);
+    }
+}
+
+/**
+ * @brief 把所有区域包含的像素合并到掩码中，可用于ll_mlx90640_set_lazy
+ *
+ * @param set 指向区域组
+ * @param mask 每行一个字，bit n对应第n列，不会清除原有的位
+ */
+void ll_mlx90640_roi_get_mask(const struct ll_mlx90640_roi_set *set, uint32_t *mask)
+{
+    const struct ll_mlx90640_roi *roi;
+    uint32_t bits;
+    int i, k;
+
+    LL_ASSERT(set && mask);
+    for (k = 0; k < set->numb; k++)
+    {
+        roi = &set->roi[k];
+        bits = 0xffffffffUL >> (32 - roi->w) << roi->x;
+        for (i = roi->y; i < roi->y + roi->h; i++)
+            mask[i] |= roi->mask ? roi->mask[i] & bits : bits;
+    }
+}
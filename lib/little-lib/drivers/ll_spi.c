@@ -44,10 +44,22 @@ static void release_bus(struct ll_spi_dev *dev)
         dev->spi->ops->hard_cs_ctrl(dev->spi, false);
 }
 
+static inline void spi_set_dc(struct ll_spi_bus *bus, struct ll_spi_trans *trans)
+{
+    if (bus->dev->dc_pin)
+    {
+        if (trans->cmd)
+            ll_pin_low(bus->dev->dc_pin);
+        else
+            ll_pin_high(bus->dev->dc_pin);
+    }
+}
+
 static int spi_trans(struct ll_spi_bus *bus, struct ll_spi_trans *trans)
 {
     size_t trans_size;
 
+    spi_set_dc(bus, trans);
     if (trans->dir == __LL_SPI_DIR_SEND)
     {
         LL_ASSERT(bus->dev->parent.drv_mode & __LL_DRV_MODE_WRITE);
@@ -66,6 +78,53 @@ static int spi_trans(struct ll_spi_bus *bus, struct ll_spi_trans *trans)
     return 0;
 }
 
+/**
+ * @brief 判断一次传输是否走轮询，中断往返的开销比发送几个字节还大
+ */
+static inline bool spi_can_poll(struct ll_spi_bus *bus, struct ll_spi_trans *trans)
+{
+    return bus->ops->poll_send &&
+           trans->dir == __LL_SPI_DIR_SEND &&
+           trans->size <= LL_SPI_POLL_THRESHOLD &&
+           !bus->dev->conf.send_addr_not_inc;
+}
+
+/**
+ * @brief 从bus->trans_index开始继续传输消息，不超过门限的传输直接轮询完成
+ *
+ * @param bus 指向spi总线的指针
+ * @param msg 指向当前的消息
+ * @return int 启动了一次中断传输返回1，消息已传输完成返回0，失败返回负数
+ */
+static int spi_xfer_next(struct ll_spi_bus *bus, struct ll_spi_msg *msg)
+{
+    struct ll_spi_trans *trans;
+    int res;
+
+    while (bus->trans_index < msg->size)
+    {
+        trans = &msg->trans[bus->trans_index++];
+        if (spi_can_poll(bus, trans))
+        {
+            spi_set_dc(bus, trans);
+            if (bus->ops->poll_send(bus, trans->buf, trans->size) != trans->size)
+            {
+                LL_ERROR("failed to spi transfer");
+                return -EIO;
+            }
+            msg->poll_numb++;
+            bus->stat.poll_trans++;
+            continue;
+        }
+        res = spi_trans(bus, trans);
+        if (res)
+            return res;
+        bus->stat.irq_trans++;
+        return 1;
+    }
+    return 0;
+}
+
 static void noticy_or_exec_cb(struct ll_spi_msg *msg, BaseType_t *woken)
 {
     if (msg->thread)
@@ -82,7 +141,7 @@ static void noticy_or_exec_cb(struct ll_spi_msg *msg, BaseType_t *woken)
     else
     {
         if (msg->complete)
-            msg->complete(msg->result);
+            msg->complete(msg->priv, msg->result);
     }
 }
 
@@ -95,17 +154,9 @@ void __ll_spi_irq_handler(struct ll_spi_dev *dev)
 
     LL_ASSERT(dev && dev->spi->parent.drv_mode & __LL_DRV_MODE_ASYNC_WRITE);
     msg = (struct ll_spi_msg *)ll_list_first(&bus->msg_head);
-    if (bus->trans_index < msg->size)
-    {
-        msg->result = spi_trans(bus, &msg->trans[bus->trans_index]);
-        if (!msg->result)
-        {
-            bus->trans_index++;
-            return;
-        }
-    }
-    else
-        msg->result = 0;
+    msg->result = spi_xfer_next(bus, msg);
+    if (msg->result > 0)
+        return;
     release_bus(msg->dev);
     noticy_or_exec_cb(msg, &woken);
     temp = taskENTER_CRITICAL_FROM_ISR();
@@ -120,22 +171,25 @@ void __ll_spi_irq_handler(struct ll_spi_dev *dev)
         else
         {
             msg = (struct ll_spi_msg *)ll_list_first(&bus->msg_head);
-            msg->result = take_bus(bus->dev);
+            msg->result = take_bus(msg->dev);
             if (!msg->result)
             {
-                bus->trans_index = 1;
-                msg->result = spi_trans(bus, &msg->trans[0]);
+                bus->trans_index = 0;
+                msg->result = spi_xfer_next(bus, msg);
             }
-            if (msg->result)
+            if (msg->result <= 0)
             {
-                release_bus(bus->dev);
+                release_bus(msg->dev);
                 ll_list_delete(&msg->node);
                 taskEXIT_CRITICAL_FROM_ISR(temp);
                 noticy_or_exec_cb(msg, &woken);
                 temp = taskENTER_CRITICAL_FROM_ISR();
             }
             else
+            {
+                msg->result = 0;
                 break;
+            }
         }
     }
     taskEXIT_CRITICAL_FROM_ISR(temp);
@@ -168,6 +222,8 @@ int __ll_spi_bus_register(struct ll_spi_bus *bus,
     ll_list_head_init(&bus->dev_head);
     bus->trans_index = 0;
     bus->send_busy = 0;
+    bus->stat.poll_trans = 0;
+    bus->stat.irq_trans = 0;
     bus->cs_hard_max_numb = 0;
     bus->lock = NULL;
 
@@ -207,12 +263,19 @@ static inline int spi_poll_xfer(struct ll_spi_msg *msg)
     return res;
 }
 
+/**
+ * @brief 把消息加入总线的队列，总线空闲时立即开始传输
+ *
+ * @param msg 指向消息的指针
+ * @return int 消息等待中断完成返回0，已经全部轮询完成返回1，失败返回负数
+ */
 static inline int spi_int_trans(struct ll_spi_msg *msg)
 {
     int res = 0;
     uint32_t temp;
     struct ll_spi_bus *bus = msg->dev->spi;
 
+    msg->poll_numb = 0;
     temp = taskENTER_CRITICAL_FROM_ISR();
     ll_list_add_tail(&bus->msg_head, &msg->node);
     if (!bus->send_busy)
@@ -220,16 +283,21 @@ static inline int spi_int_trans(struct ll_spi_msg *msg)
         res = take_bus(msg->dev);
         if (!res)
         {
-            bus->trans_index = 1;
-            res = spi_trans(bus, &msg->trans[0]);
+            bus->trans_index = 0;
+            res = spi_xfer_next(bus, msg);
         }
-        if (res)
+        if (res > 0)
+        {
+            bus->send_busy = 1;
+            res = 0;
+        }
+        else
         {
             release_bus(msg->dev);
             ll_list_delete(&msg->node);
+            if (!res)
+                res = 1;
         }
-        else
-            bus->send_busy = 1;
     }
     taskEXIT_CRITICAL_FROM_ISR(temp);
 
@@ -256,10 +324,17 @@ int ll_spi_sync(struct ll_spi_dev *dev, struct ll_spi_msg *msg)
         int res;
         msg->thread = xTaskGetCurrentTaskHandle();
         res = spi_int_trans(msg);
+        if (res > 0)
+        {
+            msg->result = 0;
+            return 0;
+        }
         if (!res)
         {
             if (ulTaskNotifyTakeIndexed(1, pdTRUE, portMAX_DELAY) != 1)
                 res = -EINVAL;
+            else
+                res = msg->result;
         }
         return res;
     }
@@ -270,19 +345,32 @@ int ll_spi_sync(struct ll_spi_dev *dev, struct ll_spi_msg *msg)
 /**
  * @brief spi异步传输
  *
+ * 消息中的传输都不超过LL_SPI_POLL_THRESHOLD且总线空闲时，
+ * 会轮询发送完成并在返回前调用complete
+ *
  * @param dev 指向spi设备的指针
  * @param msg 指向消息队列的指针
  * @return int 成功返回0，失败返回一个负数
  */
 int ll_spi_async(struct ll_spi_dev *dev, struct ll_spi_msg *msg)
 {
+    int res;
+
     LL_ASSERT(dev && dev->parent.init && msg && dev->spi->parent.init &&
               dev->spi->parent.drv_mode & (__LL_DRV_MODE_ASYNC_WRITE | __LL_DRV_MODE_ASYNC_READ));
     if (!msg->size)
         return 0;
     msg->dev = dev;
     msg->thread = NULL;
-    return spi_int_trans(msg);
+    res = spi_int_trans(msg);
+    if (res > 0)
+    {
+        res = 0;
+        msg->result = 0;
+        if (msg->complete)
+            msg->complete(msg->priv, 0);
+    }
+    return res;
 }
 
 /**
@@ -317,11 +405,13 @@ int ll_spi_config(struct ll_spi_dev *dev, struct ll_spi_conf *conf)
  * @param trans 指向spi_trans的指针
  * @param size 需要传输spi_trans的数量
  * @param complete 用来通知传输完成的回调函数
+ * @param priv complete的入参
  */
 void ll_spi_msg_init(struct ll_spi_msg *msg,
                      struct ll_spi_trans *trans,
                      size_t size,
-                     void (*complete)(int res))
+                     void (*complete)(void *priv, int res),
+                     void *priv)
 {
     LL_ASSERT(msg && trans);
     if (!size)
@@ -330,6 +420,8 @@ void ll_spi_msg_init(struct ll_spi_msg *msg,
     msg->size = size;
     msg->dev = NULL;
     msg->complete = complete;
+    msg->priv = priv;
+    msg->poll_numb = 0;
     msg->thread = NULL;
     msg->result = 0;
 }
@@ -87,6 +87,7 @@ extern "C" {
 
 #define __LL_UNUSED __attribute__((unused))
 #define __LL_USED   __attribute__((used))
+#define __LL_ALWAYS_INLINE inline __attribute__((always_inline))
 
 #ifdef __cplusplus
 }
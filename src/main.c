@@ -12,29 +12,146 @@
 #include "main.h"
 #define LL_LOG_LEVEL LL_LOG_LEVEL_DEBUG
 #include "ll_disp.h"
+#include "ll_flash.h"
 #include "ll_i2c.h"
 #include "ll_log.h"
 #include "ll_mlx90640.h"
+#include "ll_mlx90640_roi.h"
 #include "ll_pin.h"
 
 #include "FreeRTOS.h"
 #include "task.h"
 #include "timers.h"
 
+#include <string.h>
+
+#define THERMAL_WIDTH 85 //按8/3倍放大到屏幕的高度
+#define THERMAL_BAND  6  //条带缓存的行数，无阻塞刷新时分成两块轮流使用
+
 static TimerHandle_t timer0;
 static struct ll_pin *led;
 static struct ll_disp_drv *lcd;
 static struct ll_i2c_bus *i2c;
 static struct ll_mlx90640 mlx90640;
+static struct ll_mlx90640_gov mlx90640_gov;
+static struct ll_mlx90640_filter mlx90640_filter;
+static struct ll_mlx90640_stats mlx90640_stats;
+static struct ll_mlx90640_roi_set mlx90640_roi;
 struct ll_mlx90640_fixed_params *params;
+static struct ll_mlx90640_ram_buf *ram_buf;
+static struct ll_mlx90640_ir_data *ir_data;
+static struct ll_mlx90640_palette_data *palette;
+static uint16_t *band_buf;
 
 void timer_cb(TimerHandle_t timer)
 {
     ll_pin_toggle(led);
 }
 
+/**
+ * @brief 屏幕无阻塞填充完成的通知
+ */
+static void lcd_fill_cb(void *priv)
+{
+    BaseType_t woken = 0;
+
+    vTaskNotifyGiveIndexedFromISR(priv, 1, &woken);
+    portYIELD_FROM_ISR(woken);
+}
+
+/**
+ * @brief 把调色板索引转换为RGB565颜色，按屏幕的字节序保存
+ */
+static uint16_t thermal_color(uint8_t index)
+{
+    uint8_t r, g, b;
+    uint16_t color;
+
+    r = index < 128 ? index << 1 : 255;
+    g = index < 128 ? 0 : (index - 128) << 1;
+    if (index < 64)
+        b = index << 2;
+    else if (index < 128)
+        b = (127 - index) << 2;
+    else if (index < 192)
+        b = 0;
+    else
+        b = (index - 192) << 2;
+    color = (r >> 3) << 11 | (g >> 2) << 5 | b >> 3;
+    return color >> 8 | color << 8;
+}
+
+/**
+ * @brief 按上一帧的调色板索引调整色标的温度范围
+ *
+ * 索引与温度近似线性，由最小和最大索引换算回温度并留出1℃的余量，
+ * 有像素超出色标时向外扩展四分之一，不需要整帧的温度
+ */
+static void thermal_range_update(const struct ll_mlx90640_palette_data *data, float *t_min, float *t_max)
+{
+    float span = *t_max - *t_min;
+    float lo, hi;
+    int n, i_min = 255, i_max = 0;
+
+    for (n = 0; n < 768; n++)
+    {
+        i_min = LL_MIN(i_min, data->index[n]);
+        i_max = LL_MAX(i_max, data->index[n]);
+    }
+    lo = i_min ? *t_min + span * i_min / 255 - 1.0f : *t_min - span / 4;
+    hi = i_max < 255 ? *t_min + span * i_max / 255 + 1.0f : *t_max + span / 4;
+    *t_min = LL_MAX(lo, -40.0f);
+    *t_max = LL_MIN(LL_MAX(hi, *t_min + 2.0f), 300.0f);
+}
+
+/**
+ * @brief 生成热像的一个条带，按最近邻放大到屏幕上
+ */
+static int thermal_render(void *priv, const struct ll_disp_rect *band, void *buf)
+{
+    const struct ll_mlx90640_palette_data *data = priv;
+    uint16_t *p = buf;
+    int x, y;
+
+    for (y = band->y1; y <= band->y2; y++)
+    {
+        for (x = band->x1; x <= band->x2; x++)
+            *p++ = thermal_color(data->index[(y * 3 / 8) * 32 + x * 3 / 8]);
+    }
+    return 0;
+}
+
+/**
+ * @brief 获取mlx90640的校准参数，优先使用flash中的缓存，缓存无效时从eeprom恢复并更新缓存
+ *
+ * @return int 成功返回0，失败返回一个负数
+ */
+static int mlx90640_params_init(void)
+{
+    int res;
+    struct ll_flash *calib = (struct ll_flash *)ll_drv_find_by_name("calib");
+    struct ll_mlx90640_ee_buf *ee_buf;
+
+    if (calib && !ll_mlx90640_load_params(&mlx90640, calib, params))
+    {
+        LL_DEBUG("load params from flash");
+        return 0;
+    }
+    ee_buf = pvPortMalloc(sizeof(struct ll_mlx90640_ee_buf));
+    if (!ee_buf)
+        return -ENOMEM;
+    res = ll_mlx90640_get_params(&mlx90640, ee_buf, params);
+    vPortFree(ee_buf);
+    if (!res && calib && ll_mlx90640_save_params(&mlx90640, calib, params))
+        LL_WARN("save params failed");
+    return res;
+}
+
 int main(void)
 {
+    uint32_t roi_mask[24];
+    float t_min = -20.0f, t_max = 120.0f;
+
     led = (struct ll_pin *)ll_drv_find_by_name("led");
     if (led)
     {
@@ -48,9 +165,12 @@ int main(void)
         LL_DEBUG("lcd init OK");
         ll_disp_init(lcd, LL_DRV_MODE_NONBLOCK_WRITE);
         ll_disp_set_backlight(lcd, LL_DISP_BACKLIGHT_MAX);
-        ll_disp_fill_color(lcd,
-                           &(struct ll_disp_rect){0, 0, ll_disp_get_width(lcd) - 1, ll_disp_get_hight(lcd) - 1},
-                           &(uint16_t){0xffff});
+        ll_disp_set_cb(lcd, lcd_fill_cb, xTaskGetCurrentTaskHandle());
+        if (!ll_disp_fill_color(lcd,
+                                &(struct ll_disp_rect){0, 0, ll_disp_get_width(lcd) - 1, ll_disp_get_hight(lcd) - 1},
+                                &(uint16_t){0xffff}))
+            ulTaskNotifyTakeIndexed(1, pdTRUE, portMAX_DELAY);
+        ll_disp_set_cb(lcd, NULL, NULL);
         ll_disp_on_off(lcd, true);
     }
     i2c = (struct ll_i2c_bus *)ll_drv_find_by_name("i2c0");
@@ -60,21 +180,101 @@ int main(void)
             LL_ERROR("mlx90640 init failed");
         else
         {
-            struct ll_mlx90640_ee_buf *ee_buf = pvPortMalloc(sizeof(struct ll_mlx90640_ee_buf));
             params = pvPortMalloc(sizeof(struct ll_mlx90640_fixed_params));
-            if (ee_buf && params)
+            if (params && !mlx90640_params_init())
             {
-                if (!ll_mlx90640_get_params(&mlx90640, ee_buf, params))
+                ram_buf = pvPortMalloc(sizeof(struct ll_mlx90640_ram_buf));
+                ir_data = pvPortMalloc(sizeof(struct ll_mlx90640_ir_data));
+                if (lcd)
+                {
+                    palette = pvPortMalloc(sizeof(struct ll_mlx90640_palette_data));
+                    band_buf = pvPortMalloc(THERMAL_WIDTH * THERMAL_BAND * sizeof(uint16_t));
+                    if (palette)
+                        memset(palette, 0, sizeof(struct ll_mlx90640_palette_data));
+                }
+                LL_DEBUG("get params OK");
+                //噪声方差约为原来的1/4，相当于刷新率降低到1/4时的噪声；
+                //只对区域内计算温度的像素滤波，显示的调色板索引不经过滤波
+                ll_mlx90640_filter_init(&mlx90640_filter, 102, 0.5f, 2.0f);
+                ll_mlx90640_set_filter(&mlx90640, &mlx90640_filter);
+                ll_mlx90640_roi_init(&mlx90640_roi);
+                ll_mlx90640_roi_add_rect(&mlx90640_roi, 14, 10, 4, 4, 40);
+                //显示只使用调色板索引，温度只需要计算区域内的像素
+                memset(roi_mask, 0, sizeof(roi_mask));
+                ll_mlx90640_roi_get_mask(&mlx90640_roi, roi_mask);
+                ll_mlx90640_stats_init(&mlx90640_stats, params, roi_mask, -20, 120);
+                ll_mlx90640_add_stats(&mlx90640, &mlx90640_stats);
+                ll_mlx90640_set_lazy(&mlx90640, roi_mask);
+                if (ram_buf && ir_data && ll_mlx90640_acq_start(&mlx90640, ram_buf, 2))
                 {
-                    struct ll_mlx90640_ram_buf *ram_buf = pvPortMalloc(sizeof(struct ll_mlx90640_ram_buf));
-                    ll_mlx90640_calculate_temp(&mlx90640, params, ram_buf);
-                    LL_DEBUG("get params OK");
+                    LL_ERROR("mlx90640 acq start failed");
+                    vPortFree(ram_buf);
+                    ram_buf = NULL;
                 }
+                if (ram_buf && ir_data && ll_mlx90640_gov_start(&mlx90640_gov,
+                                                                &mlx90640,
+                                                                &(struct ll_mlx90640_gov_conf){
+                                                                    .min_rate = LL_MLX90640_RATE_1,
+                                                                    .max_rate = LL_MLX90640_RATE_16,
+                                                                    .headroom = 20,
+                                                                    .hysteresis = 10,
+                                                                    .up_hold = 3,
+                                                                    .interval = 2000,
+                                                                    .auto_pattern = 1,
+                                                                },
+                                                                1))
+                    LL_WARN("mlx90640 gov start failed");
             }
         }
     }
     while (1)
     {
-        vTaskDelay(20);
+        if (ram_buf && ir_data)
+        {
+            enum ll_mlx90640_pattern pattern;
+            int subpage = ll_mlx90640_acq_wait(&mlx90640, 1000);
+            if (subpage < 0)
+            {
+                LL_WARN("mlx90640 wait timeout");
+                continue;
+            }
+            ll_mlx90640_gov_begin(&mlx90640_gov);
+            ll_mlx90640_calculate_subpage(&mlx90640, params, ram_buf, subpage, ir_data);
+            if (palette && band_buf &&
+                !ll_mlx90640_calculate_palette(&mlx90640, params, ram_buf, subpage, t_min, t_max, palette))
+                thermal_range_update(palette, &t_min, &t_max);
+            pattern = ll_mlx90640_get_pattern(ram_buf);
+            ll_mlx90640_acq_release(&mlx90640);
+            if (palette && band_buf &&
+                ll_disp_render(lcd,
+                               &(struct ll_disp_rect){0, 0, THERMAL_WIDTH - 1, ll_disp_get_hight(lcd) - 1},
+                               band_buf,
+                               THERMAL_WIDTH * THERMAL_BAND * sizeof(uint16_t),
+                               thermal_render,
+                               palette))
+                LL_WARN("lcd render failed");
+            ll_mlx90640_roi_update(&mlx90640_roi, ir_data, subpage, pattern);
+            //日志在统计负载的区间之外，避免调速器把串口输出计入处理时间
+            ll_mlx90640_gov_end(&mlx90640_gov);
+            LL_DEBUG("center %.2f min %.2f max %.2f@%u mean %.2f polls %u load %u%% bus %u%%",
+                     LL_MLX90640_TEMP_TO_FLOAT(ir_data->temp[12 * 32 + 16]),
+                     LL_MLX90640_TEMP_TO_FLOAT(mlx90640_stats.frame.min),
+                     LL_MLX90640_TEMP_TO_FLOAT(mlx90640_stats.frame.max),
+                     mlx90640_stats.frame.argmax,
+                     LL_MLX90640_TEMP_TO_FLOAT(mlx90640_stats.frame.mean),
+                     mlx90640.acq_stat.last_polls,
+                     mlx90640_gov.load,
+                     mlx90640_gov.bus_load);
+            LL_DEBUG("roi spot %.2f max %.2f area %u centroid (%u.%02u, %u.%02u)",
+                     LL_MLX90640_TEMP_TO_FLOAT(mlx90640_roi.roi[0].result.spot),
+                     LL_MLX90640_TEMP_TO_FLOAT(mlx90640_roi.roi[0].result.max),
+                     mlx90640_roi.roi[0].result.area,
+                     mlx90640_roi.roi[0].result.cx >> 8,
+                     (mlx90640_roi.roi[0].result.cx & 0xff) * 100 >> 8,
+                     mlx90640_roi.roi[0].result.cy >> 8,
+                     (mlx90640_roi.roi[0].result.cy & 0xff) * 100 >> 8);
+        }
+        else
+            vTaskDelay(20);
     }
 }
\ No newline at end of file
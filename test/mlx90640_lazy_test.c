@@ -0,0 +1,100 @@
+/**
+ * @file mlx90640_lazy_test.c
+ * @brief 懒计算模式下重新开始计算的像素不使用过期的滤波历史值
+ *
+ * 整帧计算后切换到只计算第0行的懒计算模式，场景温度升高，再加入统计第1行的帧统计，
+ * 第1行第一次计算的温度和统计的最小值应与参考一致，而不是与过期的历史值混合
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+#include "ll_mlx90640.h"
+#include "mlx90640_sim.h"
+
+#include <math.h>
+#include <stdio.h>
+
+#ifdef LL_MLX90640_USING_FIXED_POINT
+#define TO_MAX_ERROR 0.05
+#else
+#define TO_MAX_ERROR 0.01
+#endif
+
+static struct ll_mlx90640 mlx90640;
+static struct ll_mlx90640_ee_buf ee_buf;
+static struct ll_mlx90640_fixed_params params;
+static struct ll_mlx90640_ram_buf ram_buf;
+static struct ll_mlx90640_ir_data ir_data;
+static struct ll_mlx90640_filter filter;
+static struct ll_mlx90640_stats stats;
+
+/**
+ * @brief 生成均匀温度的场景并计算一帧
+ *
+ * @param t 场景温度(℃)
+ * @param ref 用于保存参考温度
+ * @return int 成功返回0，失败返回一个负数
+ */
+static int frame_calculate(double t, double *ref)
+{
+    double scene[768], ta;
+    int n, res;
+
+    for (n = 0; n < 768; n++)
+        scene[n] = t;
+    sim_make_ram(scene);
+    for (n = 0; (res = ll_mlx90640_read_raw_data(&mlx90640, &ram_buf)) == -EAGAIN && n < 4; n++)
+        ;
+    if (res)
+        return res;
+    sim_ref_to(1.0, ref, &ta);
+    return ll_mlx90640_calculate_temp(&mlx90640, &params, &ram_buf, &ir_data);
+}
+
+int main(void)
+{
+    static const uint32_t row0[24] = {0xffffffff};
+    static const uint32_t row1[24] = {0, 0xffffffff};
+    double ref[768], err, max_err = 0, min_ref = INFINITY;
+    int i, n, pass;
+
+    sim_make_eeprom(0x20);
+    if (ll_mlx90640_init(&mlx90640, (struct ll_i2c_bus *)&mlx90640, LL_MLX90640_RATE_2) ||
+        ll_mlx90640_get_params(&mlx90640, &ee_buf, &params))
+    {
+        printf("init failed\n");
+        return 1;
+    }
+    //变化量在noise和motion之间，滤波后与新值有明显差别
+    ll_mlx90640_filter_init(&filter, 32, 0.5f, 40.0f);
+    ll_mlx90640_set_filter(&mlx90640, &filter);
+    for (i = 0; i < 2; i++)
+    {
+        if (frame_calculate(20, ref))
+            return 1;
+    }
+    ll_mlx90640_set_lazy(&mlx90640, row0);
+    for (i = 0; i < 3; i++)
+    {
+        if (frame_calculate(40, ref))
+            return 1;
+    }
+    //帧统计的像素总是会被计算，第1行从这一帧开始重新计算
+    ll_mlx90640_stats_init(&stats, &params, row1, -20, 120);
+    ll_mlx90640_add_stats(&mlx90640, &stats);
+    if (frame_calculate(40, ref))
+        return 1;
+    for (n = 32; n < 64; n++)
+    {
+        err = fabs(LL_MLX90640_TEMP_TO_FLOAT(ir_data.temp[n]) - ref[n]);
+        if (!(err <= max_err))
+            max_err = err;
+        if (ref[n] < min_ref)
+            min_ref = ref[n];
+    }
+    err = fabs(LL_MLX90640_TEMP_TO_FLOAT(stats.frame.min) - min_ref);
+    pass = max_err <= TO_MAX_ERROR && err <= TO_MAX_ERROR;
+    printf("row 1 max error %.4f, stats min error %.4f, limit %.2f: %s\n",
+           max_err, err, TO_MAX_ERROR, pass ? "PASS" : "FAIL");
+    return pass ? 0 : 1;
+}
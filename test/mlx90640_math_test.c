@@ -0,0 +1,170 @@
+/**
+ * @file mlx90640_math_test.c
+ * @brief ll_mlx90640.c中查表求倒数和四次方根的精度与速度，以libm为参考
+ *
+ * 浮点版本检查recipf(相对误差不超过1e-6)和root4f(相对误差不超过2.5e-7)，
+ * 定点版本(LL_MLX90640_USING_FIXED_POINT)检查root4_q6(误差不超过0.51个最低位)。
+ * 算法只与尾数和指数的低两位有关，指数在[0, 4)内的输入逐个检查，其余指数按固定步长抽取尾数；
+ * root4_q6在2^24以下的输入逐个检查，以上按质数步长抽取。
+ * 速度为主机上的结果，只用于比较同一台机器上的相对快慢
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+#include "../lib/little-lib/drivers/ll_mlx90640.c"
+
+#include <stdio.h>
+#include <time.h>
+
+#define BENCH_NUMB (1 << 24)
+
+static double now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+#ifndef LL_MLX90640_USING_FIXED_POINT
+/**
+ * @brief 检查一个浮点函数在全部正的规格化数上的最大相对误差
+ *
+ * @param func 被测函数
+ * @param ref 参考函数
+ * @param worst_x 用于保存误差最大时的输入
+ * @return double 最大相对误差
+ */
+static double float_sweep(float (*func)(float), double (*ref)(double), float *worst_x)
+{
+    union
+    {
+        float f;
+        uint32_t u;
+    } v;
+    uint32_t e, m, step;
+    double r, err, max_err = 0;
+
+    for (e = 1; e < 255; e++)
+    {
+        //1 <= x < 16时逐个检查，其余指数按质数步长抽取
+        step = e >= 127 && e < 131 ? 1 : 4099;
+        for (m = 0; m < (1u << 23); m += step)
+        {
+            v.u = e << 23 | m;
+            r = ref(v.f);
+            err = fabs(func(v.f) - r) / r;
+            if (!(err <= max_err))
+            {
+                max_err = err;
+                *worst_x = v.f;
+            }
+        }
+    }
+    return max_err;
+}
+
+static double recip(double x)
+{
+    return 1 / x;
+}
+
+static double root4(double x)
+{
+    return pow(x, 0.25);
+}
+
+static float recipf_libm(float x)
+{
+    return 1 / x;
+}
+
+static float root4f_libm(float x)
+{
+    return sqrtf(sqrtf(x));
+}
+
+/**
+ * @brief 对-40~300℃附近的输入测试速度
+ *
+ * @return double 每次调用的时间(ns)
+ */
+static double float_bench(float (*func)(float), float x0, float dx)
+{
+    volatile float sink;
+    float x = x0, sum = 0;
+    double t;
+    int i;
+
+    t = now();
+    for (i = 0; i < BENCH_NUMB; i++)
+    {
+        sum += func(x);
+        x += dx;
+    }
+    sink = sum;
+    (void)sink;
+    return (now() - t) * 1e9 / BENCH_NUMB;
+}
+
+int main(void)
+{
+    float x_recip = 0, x_root4 = 0;
+    double err_recip = float_sweep(recipf, recip, &x_recip);
+    double err_root4 = float_sweep(root4f, root4, &x_root4);
+    int pass = err_recip <= 1e-6 && err_root4 <= 2.5e-7;
+
+    printf("recipf max rel error %.3g at %g (limit 1e-6)\n", err_recip, x_recip);
+    printf("root4f max rel error %.3g at %g (limit 2.5e-7)\n", err_root4, x_root4);
+    printf("recipf %.2f ns, 1 / x %.2f ns\n",
+           float_bench(recipf, 0.5f, 1e-7f), float_bench(recipf_libm, 0.5f, 1e-7f));
+    printf("root4f %.2f ns, sqrtf(sqrtf(x)) %.2f ns\n",
+           float_bench(root4f, 5.4e9f, 500.0f), float_bench(root4f_libm, 5.4e9f, 500.0f));
+    printf("%s\n", pass ? "PASS" : "FAIL");
+    return pass ? 0 : 1;
+}
+#else
+static int32_t root4_q6_libm(int32_t x)
+{
+    return x > 0 ? lround(sqrt(sqrt((double)x * 256)) * 64) : 0;
+}
+
+static double q6_bench(int32_t (*func)(int32_t))
+{
+    volatile int32_t sink;
+    int32_t sum = 0;
+    double t;
+    int i;
+
+    t = now();
+    for (i = 0; i < BENCH_NUMB; i++)
+        sum += func(1 << 24 | i << 3);
+    sink = sum;
+    (void)sink;
+    return (now() - t) * 1e9 / BENCH_NUMB;
+}
+
+int main(void)
+{
+    uint32_t x;
+    int32_t worst_x = 0;
+    double err, max_err = 0;
+    int pass;
+
+    //(x * 2^8)^(1/4) * 2^6 = x^(1/4) * 256
+    for (x = 1; x <= INT32_MAX; x += x < (1 << 24) ? 1 : 61)
+    {
+        err = fabs(root4_q6((int32_t)x) - sqrt(sqrt((double)x)) * 256);
+        if (err > max_err)
+        {
+            max_err = err;
+            worst_x = (int32_t)x;
+        }
+    }
+    pass = max_err <= 0.51;
+    printf("root4_q6 max error %.4f LSB at %d (limit 0.51)\n", max_err, worst_x);
+    printf("root4_q6 %.2f ns, sqrt(sqrt(x)) %.2f ns\n", q6_bench(root4_q6), q6_bench(root4_q6_libm));
+    printf("%s\n", pass ? "PASS" : "FAIL");
+    return pass ? 0 : 1;
+}
+#endif
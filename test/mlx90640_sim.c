@@ -0,0 +1,359 @@
+/**
+ * @file mlx90640_sim.c
+ * @brief 主机测试用的mlx90640模拟和FreeRTOS、驱动框架的替身
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+#include "mlx90640_sim.h"
+#include "ll_flash.h"
+#include "ll_i2c.h"
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+#include <math.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SIM_EE_ADDR     0x2400
+#define SIM_RAM_ADDR    0x0400
+#define SIM_STATUS_REG  0x8000
+#define SIM_CTRL_REG    0x800d
+#define SIM_NEW_DATA    0x0008
+
+uint16_t sim_ee[832];
+uint16_t sim_ram[832];
+uint16_t sim_ctrl = SIM_CTRL_DEFAULT;
+static uint16_t sim_status = SIM_NEW_DATA;
+static TickType_t sim_tick;
+
+static uint16_t sim_read(uint16_t addr)
+{
+    uint16_t status;
+
+    if (addr >= SIM_EE_ADDR && addr < SIM_EE_ADDR + 832)
+        return sim_ee[addr - SIM_EE_ADDR];
+    if (addr >= SIM_RAM_ADDR && addr < SIM_RAM_ADDR + 832)
+        return sim_ram[addr - SIM_RAM_ADDR];
+    if (addr == SIM_STATUS_REG)
+    {
+        //读完状态后总有新的数据
+        status = sim_status;
+        sim_status |= SIM_NEW_DATA;
+        return status;
+    }
+    if (addr == SIM_CTRL_REG)
+        return sim_ctrl;
+    return 0;
+}
+
+static void sim_write(uint16_t addr, uint16_t data)
+{
+    if (addr == SIM_STATUS_REG)
+        sim_status = (sim_status & ~0x0030) | (data & 0x0030) | (data & SIM_NEW_DATA);
+    else if (addr == SIM_CTRL_REG)
+        sim_ctrl = data;
+    else if (addr >= SIM_EE_ADDR && addr < SIM_EE_ADDR + 832)
+        sim_ee[addr - SIM_EE_ADDR] = data;
+}
+
+ssize_t ll_i2c_trans(struct ll_i2c_dev *dev, struct ll_i2c_msg *msgs, size_t numb)
+{
+    uint8_t *p = msgs[0].buf;
+    uint16_t addr = p[0] << 8 | p[1];
+    uint16_t data;
+    size_t i;
+
+    if (numb == 1)
+    {
+        sim_write(addr, p[2] << 8 | p[3]);
+        return 1;
+    }
+    p = msgs[1].buf;
+    for (i = 0; i < msgs[1].size / 2; i++)
+    {
+        data = sim_read(addr + i);
+        p[2 * i] = data >> 8;
+        p[2 * i + 1] = data & 0xff;
+    }
+    return 2;
+}
+
+int ll_i2c_dev_register(struct ll_i2c_dev *dev, const char *name, void *priv, int drv_mode)
+{
+    return 0;
+}
+
+int ll_flash_read(struct ll_flash *flash, uint32_t offset, void *buf, size_t size)
+{
+    return -ENODEV;
+}
+
+int ll_flash_write(struct ll_flash *flash, uint32_t offset, const void *buf, size_t size)
+{
+    return -ENODEV;
+}
+
+int ll_flash_erase(struct ll_flash *flash, uint32_t offset, size_t size)
+{
+    return -ENODEV;
+}
+
+int ll_printf(char *fmt, ...)
+{
+    return 0;
+}
+
+void *pvPortMalloc(size_t size)
+{
+    return malloc(size);
+}
+
+void vPortFree(void *p)
+{
+    free(p);
+}
+
+BaseType_t xTaskCreate(TaskFunction_t func, const char *name, uint16_t depth, void *param, UBaseType_t prio, TaskHandle_t *handle)
+{
+    return pdFAIL;
+}
+
+void vTaskDelete(TaskHandle_t task)
+{
+}
+
+void vTaskDelay(TickType_t ticks)
+{
+    sim_tick += ticks;
+}
+
+BaseType_t xTaskDelayUntil(TickType_t *prev, TickType_t inc)
+{
+    *prev += inc;
+    if (sim_tick < *prev)
+        sim_tick = *prev;
+    return pdTRUE;
+}
+
+TickType_t xTaskGetTickCount(void)
+{
+    return sim_tick;
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void)
+{
+    return NULL;
+}
+
+uint32_t ulTaskNotifyTakeIndexed(UBaseType_t index, BaseType_t clear, TickType_t ticks)
+{
+    return 1;
+}
+
+BaseType_t xTaskNotifyGiveIndexed(TaskHandle_t task, UBaseType_t index)
+{
+    return pdPASS;
+}
+
+void vTaskNotifyGiveIndexedFromISR(TaskHandle_t task, UBaseType_t index, BaseType_t *woken)
+{
+}
+
+static uint32_t sim_seed = 12345;
+
+static int sim_rand(int lo, int hi)
+{
+    sim_seed = sim_seed * 1103515245 + 12345;
+    return lo + (int)((sim_seed >> 8) % (uint32_t)(hi - lo + 1));
+}
+
+static uint16_t sim_nibbles(void)
+{
+    return (sim_rand(-3, 3) & 15) | (sim_rand(-3, 3) & 15) << 4 | (sim_rand(-3, 3) & 15) << 8 | (sim_rand(-3, 3) & 15) << 12;
+}
+
+/**
+ * @brief 生成一份数值在数据手册典型范围内的eeprom，像素参数由固定种子的伪随机数产生
+ *
+ * @param tgc eeprom中的tgc原始值，有符号8位，单位1/32
+ */
+void sim_make_eeprom(uint8_t tgc)
+{
+    int i;
+
+    sim_seed = 12345;
+    memset(sim_ee, 0, sizeof(sim_ee));
+    sim_ee[0x00] = 0x00ae;
+    sim_ee[0x01] = 0x499a;
+    sim_ee[0x10] = 9 << 12 | 2 << 8 | 1 << 4;
+    sim_ee[0x11] = (uint16_t)-53;
+    for (i = 0; i < 14; i++)
+        sim_ee[0x12 + i] = sim_nibbles();
+    sim_ee[0x20] = 6 << 12 | 3 << 8 | 3 << 4 | 2;
+    sim_ee[0x21] = 12100;
+    for (i = 0; i < 14; i++)
+        sim_ee[0x22 + i] = sim_nibbles();
+    sim_ee[0x30] = 6383;
+    sim_ee[0x31] = 12273;
+    sim_ee[0x32] = 22 << 10 | 339;
+    sim_ee[0x33] = 0x9d68;
+    sim_ee[0x34] = 4 | 3 << 4 | 5 << 8 | 4 << 12;
+    sim_ee[0x36] = 83 << 8 | 80;
+    sim_ee[0x37] = 85 << 8 | 78;
+    sim_ee[0x38] = 2 << 12 | 3 << 8 | 6 << 4 | 4;
+    sim_ee[0x39] = 2 << 10 | 300;
+    sim_ee[0x3a] = 1 << 10 | ((1024 - 75) & 0x3ff);
+    sim_ee[0x3b] = 4 << 8 | 64;
+    sim_ee[0x3c] = 0xf0 << 8 | tgc;
+    sim_ee[0x3d] = 0x9d << 8 | 0x9a;
+    sim_ee[0x3e] = 0x9f << 8 | 0x9c;
+    sim_ee[0x3f] = 1 << 12 | 8 << 8 | 10 << 4 | 9;
+    for (i = 0; i < 768; i++)
+        sim_ee[0x40 + i] = (sim_rand(-20, 20) & 0x3f) << 10 | (sim_rand(-25, 25) & 0x3f) << 4 | (sim_rand(-3, 3) & 7) << 1;
+}
+
+static int sign_extend(int v, int bits)
+{
+    return v >= 1 << (bits - 1) ? v - (1 << bits) : v;
+}
+
+/**
+ * @brief 按数据手册第11章用双精度计算整帧的温度，作为被测实现的参考
+ *
+ * @param emissivity 发射率
+ * @param out 用于保存768个像素的温度(℃)
+ * @param ta 用于保存Ta(℃)，可以为NULL
+ */
+void sim_ref_to(double emissivity, double *out, double *ta)
+{
+    const uint16_t *ee = sim_ee, *ram = sim_ram;
+    int chess = sim_ctrl >> 12 & 1;
+    int calib_chess = !(ee[0x0a] & 0x0800);
+    double ilc0 = sign_extend(ee[0x35] & 0x3f, 6) / 16.0;
+    double ilc1 = sign_extend(ee[0x35] >> 6 & 0x1f, 5) / 2.0;
+    double ilc2 = sign_extend(ee[0x35] >> 11, 5) / 8.0;
+    int kvdd = sign_extend(ee[0x33] >> 8, 8) * 32;
+    int vdd25 = ((ee[0x33] & 0xff) - 256) * 32 - 8192;
+    double res_corr = pow(2, ee[0x38] >> 12 & 3) / pow(2, sim_ctrl >> 10 & 3);
+    double dv = (res_corr * (int16_t)ram[768 + 0x2a] - vdd25) / kvdd;
+    double kv_ptat = sign_extend(ee[0x32] >> 10, 6) / 4096.0;
+    double kt_ptat = sign_extend(ee[0x32] & 0x3ff, 10) / 8.0;
+    double alpha_ptat = (ee[0x10] >> 12) / 4.0 + 8;
+    double v_ptat = (int16_t)ram[768 + 0x20], v_be = (int16_t)ram[768 + 0x00];
+    double v_ptat_art = v_ptat / (v_ptat * alpha_ptat + v_be) * 262144.0;
+    double t_a = (v_ptat_art / (1 + kv_ptat * dv) - (int16_t)ee[0x31]) / kt_ptat + 25;
+    double kgain = (double)(int16_t)ee[0x30] / (int16_t)ram[768 + 0x0a];
+    int kv_scale = ee[0x38] >> 8 & 15;
+    double kv[2][2] = {
+        {sign_extend(ee[0x34] >> 12 & 15, 4) / pow(2, kv_scale), sign_extend(ee[0x34] >> 4 & 15, 4) / pow(2, kv_scale)},
+        {sign_extend(ee[0x34] >> 8 & 15, 4) / pow(2, kv_scale), sign_extend(ee[0x34] & 15, 4) / pow(2, kv_scale)},
+    };
+    int kta_rc[2][2] = {
+        {sign_extend(ee[0x36] >> 8, 8), sign_extend(ee[0x37] >> 8, 8)},
+        {sign_extend(ee[0x36] & 0xff, 8), sign_extend(ee[0x37] & 0xff, 8)},
+    };
+    int kta_scale_1 = (ee[0x38] >> 4 & 15) + 8, kta_scale_2 = ee[0x38] & 15;
+    int occ_row = ee[0x10] >> 8 & 15, occ_col = ee[0x10] >> 4 & 15, occ_rem = ee[0x10] & 15;
+    int acc_row = ee[0x20] >> 8 & 15, acc_col = ee[0x20] >> 4 & 15, acc_rem = ee[0x20] & 15;
+    int alpha_scale = (ee[0x20] >> 12) + 30;
+    double ks_ta = sign_extend(ee[0x3c] >> 8, 8) / 8192.0;
+    double tgc = sign_extend(ee[0x3c] & 0xff, 8) / 32.0;
+    int ks_to_scale = (ee[0x3f] & 15) + 8;
+    double ks_to[4] = {
+        sign_extend(ee[0x3d] & 0xff, 8) / pow(2, ks_to_scale),
+        sign_extend(ee[0x3d] >> 8, 8) / pow(2, ks_to_scale),
+        sign_extend(ee[0x3e] & 0xff, 8) / pow(2, ks_to_scale),
+        sign_extend(ee[0x3e] >> 8, 8) / pow(2, ks_to_scale),
+    };
+    int step = (ee[0x3f] >> 12 & 3) * 10;
+    double ct[4] = {-40, 0, (ee[0x3f] >> 4 & 15) * step, (ee[0x3f] >> 8 & 15) * step + (ee[0x3f] >> 4 & 15) * step};
+    double alpha_corr[4] = {
+        1 / (1 + ks_to[0] * 40),
+        1,
+        1 + ks_to[1] * ct[2],
+        (1 + ks_to[1] * ct[2]) * (1 + ks_to[2] * (ct[3] - ct[2])),
+    };
+    double alpha_cp[2], offset_cp[2], cp[2];
+    double kv_cp = sign_extend(ee[0x3b] >> 8, 8) / pow(2, kv_scale);
+    double kta_cp = sign_extend(ee[0x3b] & 0xff, 8) / pow(2, kta_scale_1);
+    double ta4, tr4, ta_r;
+    int i, j, k;
+
+    alpha_cp[0] = (ee[0x39] & 0x3ff) / pow(2, (ee[0x20] >> 12) + 27);
+    alpha_cp[1] = alpha_cp[0] * (1 + sign_extend(ee[0x39] >> 10, 6) / 128.0);
+    offset_cp[0] = sign_extend(ee[0x3a] & 0x3ff, 10);
+    offset_cp[1] = offset_cp[0] + sign_extend(ee[0x3a] >> 10, 6) + (chess != calib_chess ? ilc0 : 0);
+    for (k = 0; k < 2; k++)
+        cp[k] = (int16_t)ram[768 + (k ? 0x28 : 0x08)] * kgain - offset_cp[k] * (1 + kta_cp * (t_a - 25)) * (1 + kv_cp * dv);
+    ta4 = pow(t_a + 273.15, 4);
+    tr4 = pow(t_a - 8 + 273.15, 4);
+    ta_r = tr4 - (tr4 - ta4) / emissivity;
+    for (i = 0; i < 24; i++)
+    {
+        for (j = 0; j < 32; j++)
+        {
+            int n = i * 32 + j;
+            int pattern = chess ? (i ^ j) & 1 : i & 1;
+            int offset = (int16_t)ee[0x11] +
+                         sign_extend(ee[0x12 + i / 4] >> (i % 4 * 4) & 15, 4) * (1 << occ_row) +
+                         sign_extend(ee[0x18 + j / 4] >> (j % 4 * 4) & 15, 4) * (1 << occ_col) +
+                         sign_extend(ee[0x40 + n] >> 10, 6) * (1 << occ_rem);
+            double alpha = (ee[0x21] +
+                            sign_extend(ee[0x22 + i / 4] >> (i % 4 * 4) & 15, 4) * (1 << acc_row) +
+                            sign_extend(ee[0x28 + j / 4] >> (j % 4 * 4) & 15, 4) * (1 << acc_col) +
+                            sign_extend(ee[0x40 + n] >> 4 & 0x3f, 6) * (1 << acc_rem)) /
+                           pow(2, alpha_scale);
+            double kta = (kta_rc[i & 1][j & 1] + sign_extend(ee[0x40 + n] >> 1 & 7, 3) * (1 << kta_scale_2)) / pow(2, kta_scale_1);
+            double os, v_ir, a, sx, to;
+            int r;
+
+            os = (int16_t)ram[n] * kgain - offset * (1 + kta * (t_a - 25)) * (1 + kv[i & 1][j & 1] * dv);
+            if (chess != calib_chess)
+            {
+                int conv = ((n + 2) / 4 - (n + 3) / 4 + (n + 1) / 4 - n / 4) * (1 - 2 * (i & 1));
+                os += ilc2 * (2 * (i & 1) - 1) - ilc1 * conv;
+            }
+            v_ir = os / emissivity - tgc * cp[pattern];
+            a = (alpha - tgc * alpha_cp[pattern]) * (1 + ks_ta * (t_a - 25));
+            sx = ks_to[1] * pow(a * a * a * v_ir + a * a * a * a * ta_r, 0.25);
+            to = pow(v_ir / (a * (1 - ks_to[1] * 273.15) + sx) + ta_r, 0.25) - 273.15;
+            r = to < ct[1] ? 0 : to < ct[2] ? 1 : to < ct[3] ? 2 : 3;
+            out[n] = pow(v_ir / (a * alpha_corr[r] * (1 + ks_to[r] * (to - ct[r]))) + ta_r, 0.25) - 273.15;
+        }
+    }
+    if (ta)
+        *ta = t_a;
+}
+
+/**
+ * @brief 生成显示给定场景的ram数据，辅助数据固定，像素数据由参考模型迭代求解
+ *
+ * @param scene 768个像素的目标温度(℃)
+ */
+void sim_make_ram(const double *scene)
+{
+    double out[768], err, v;
+    int it, n;
+
+    sim_ram[768 + 0x00] = 19000;
+    sim_ram[768 + 0x20] = 1700;
+    sim_ram[768 + 0x2a] = (uint16_t)-12900;
+    sim_ram[768 + 0x0a] = 6300;
+    sim_ram[768 + 0x08] = (uint16_t)-70;
+    sim_ram[768 + 0x28] = (uint16_t)-72;
+    memset(sim_ram, 0, 768 * sizeof(uint16_t));
+    for (it = 0; it < 40; it++)
+    {
+        sim_ref_to(1.0, out, NULL);
+        for (n = 0; n < 768; n++)
+        {
+            err = isnan(out[n]) ? 1e9 : pow(scene[n] + 273.15, 4) - pow(out[n] + 273.15, 4);
+            v = (int16_t)sim_ram[n] + err * 6e-8;
+            v = v > 32767 ? 32767 : v < -32768 ? -32768 : v;
+            sim_ram[n] = (uint16_t)(int16_t)lround(v);
+        }
+    }
+}
@@ -0,0 +1,23 @@
+/**
+ * @file mlx90640_sim.h
+ * @brief 主机测试用的mlx90640模拟：由ll_i2c_trans读写的eeprom和ram，以及按数据手册第11章计算的双精度参考
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+#ifndef __MLX90640_SIM_H__
+#define __MLX90640_SIM_H__
+
+#include <stdint.h>
+
+#define SIM_CTRL_DEFAULT 0x1901 //棋盘模式，18位分辨率，2Hz
+
+extern uint16_t sim_ee[832];
+extern uint16_t sim_ram[832];
+extern uint16_t sim_ctrl;
+
+void sim_make_eeprom(uint8_t tgc);
+void sim_make_ram(const double *scene);
+void sim_ref_to(double emissivity, double *out, double *ta);
+
+#endif
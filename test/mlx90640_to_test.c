@@ -0,0 +1,140 @@
+/**
+ * @file mlx90640_to_test.c
+ * @brief 比较ll_mlx90640_calculate_temp与双精度参考模型的温度
+ *
+ * 不带参数时使用模拟的eeprom和场景(-40~300℃，多种Ta、发射率和tgc)；
+ * 带一个文件参数时回放记录的数据：832个eeprom字，之后每帧832个ram字和1个控制寄存器字，均为小端16位。
+ * 定点版本(LL_MLX90640_USING_FIXED_POINT)的误差应不超过±0.05℃，浮点版本不超过±0.01℃
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+#include "ll_mlx90640.h"
+#include "mlx90640_sim.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#ifdef LL_MLX90640_USING_FIXED_POINT
+#define TO_MAX_ERROR 0.05
+#else
+#define TO_MAX_ERROR 0.01
+#endif
+
+static struct ll_mlx90640 mlx90640;
+static struct ll_mlx90640_ee_buf ee_buf;
+static struct ll_mlx90640_fixed_params params;
+static struct ll_mlx90640_ram_buf ram_buf;
+static struct ll_mlx90640_ir_data ir_data;
+
+/**
+ * @brief 计算当前sim_ram中的一帧并与参考比较
+ *
+ * @param emissivity 发射率
+ * @return double 在-40~300℃内的最大误差(℃)，计算失败时返回INFINITY
+ */
+static double frame_check(double emissivity)
+{
+    double ref[768], ta, err, max_err = 0;
+    int n, res;
+
+    ll_mlx90640_set_emissivity(&mlx90640, emissivity);
+    //切换模式后的第一个子界面会被丢弃
+    for (n = 0; (res = ll_mlx90640_read_raw_data(&mlx90640, &ram_buf)) == -EAGAIN && n < 4; n++)
+        ;
+    if (res)
+        return INFINITY;
+    //回放时使用记录的控制寄存器
+    ram_buf.ctrl = sim_ctrl;
+    if (ll_mlx90640_calculate_temp(&mlx90640, &params, &ram_buf, &ir_data))
+        return INFINITY;
+    sim_ref_to(emissivity, ref, &ta);
+    for (n = 0; n < 768; n++)
+    {
+        if (!(ref[n] >= -40 && ref[n] <= 300))
+            continue;
+        err = fabs(LL_MLX90640_TEMP_TO_FLOAT(ir_data.temp[n]) - ref[n]);
+        if (!(err <= max_err))
+            max_err = err;
+    }
+    return max_err;
+}
+
+static int params_init(void)
+{
+    if (ll_mlx90640_init(&mlx90640, (struct ll_i2c_bus *)&mlx90640, LL_MLX90640_RATE_2))
+        return -1;
+    return ll_mlx90640_get_params(&mlx90640, &ee_buf, &params);
+}
+
+static double sim_frames_check(void)
+{
+    static const uint8_t tgc[] = {0x01, 0x20, 0x7f, 0x80};
+    double scene[768], err, max_err, worst = 0;
+    int i, f, n;
+
+    for (i = 0; i < sizeof(tgc); i++)
+    {
+        sim_make_eeprom(tgc[i]);
+        if (params_init())
+            return INFINITY;
+        max_err = 0;
+        for (f = 0; f < 12; f++)
+        {
+            for (n = 0; n < 768; n++)
+                scene[n] = -40 + 340.0 * ((n * 37 + f * 11) % 768) / 767;
+            sim_make_ram(scene);
+            //改变Ta和Vdd
+            sim_ram[768 + 0x00] += f * 50;
+            sim_ram[768 + 0x2a] += f * 20;
+            err = frame_check(f < 6 ? 1.0 : 0.95 - 0.1 * (f - 6));
+            if (!(err <= max_err))
+                max_err = err;
+        }
+        printf("tgc 0x%02x 12 frames max error %.4f\n", tgc[i], max_err);
+        if (!(max_err <= worst))
+            worst = max_err;
+    }
+    return worst;
+}
+
+static double file_frames_check(const char *path)
+{
+    FILE *fp = fopen(path, "rb");
+    uint8_t raw[833 * 2];
+    double err, worst = 0;
+    int i, f;
+
+    if (!fp)
+    {
+        perror(path);
+        return INFINITY;
+    }
+    if (fread(raw, 2, 832, fp) != 832)
+        worst = INFINITY;
+    for (i = 0; i < 832; i++)
+        sim_ee[i] = raw[2 * i] | raw[2 * i + 1] << 8;
+    if (worst == 0 && params_init())
+        worst = INFINITY;
+    for (f = 0; worst != INFINITY && fread(raw, 2, 833, fp) == 833; f++)
+    {
+        for (i = 0; i < 832; i++)
+            sim_ram[i] = raw[2 * i] | raw[2 * i + 1] << 8;
+        sim_ctrl = raw[2 * 832] | raw[2 * 832 + 1] << 8;
+        err = frame_check(1.0);
+        printf("frame %2d max error %.4f\n", f, err);
+        if (!(err <= worst))
+            worst = err;
+    }
+    fclose(fp);
+    return worst;
+}
+
+int main(int argc, char **argv)
+{
+    double worst = argc > 1 ? file_frames_check(argv[1]) : sim_frames_check();
+
+    printf("worst %.4f, limit %.2f: %s\n", worst, TO_MAX_ERROR, worst <= TO_MAX_ERROR ? "PASS" : "FAIL");
+    return worst <= TO_MAX_ERROR ? 0 : 1;
+}
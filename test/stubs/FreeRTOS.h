@@ -0,0 +1,36 @@
+/**
+ * @file FreeRTOS.h
+ * @brief 主机测试使用的FreeRTOS最小替身，只提供驱动代码编译所需的类型和宏
+ */
+#ifndef __TEST_FREERTOS_H__
+#define __TEST_FREERTOS_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "FreeRTOSConfig.h"
+
+typedef uint32_t TickType_t;
+typedef long BaseType_t;
+typedef unsigned long UBaseType_t;
+typedef uint32_t StackType_t;
+
+#define pdTRUE        1
+#define pdFALSE       0
+#define pdPASS        1
+#define pdFAIL        0
+#define portMAX_DELAY 0xffffffffUL
+
+#define pdMS_TO_TICKS(x)   ((TickType_t)(((TickType_t)(x) * (TickType_t)configTICK_RATE_HZ) / (TickType_t)1000U))
+#define portTICK_PERIOD_MS ((TickType_t)1000 / configTICK_RATE_HZ)
+
+#define portYIELD_FROM_ISR(x)          ((void)(x))
+#define taskENTER_CRITICAL()           do {} while (0)
+#define taskEXIT_CRITICAL()            do {} while (0)
+#define taskENTER_CRITICAL_FROM_ISR()  0
+#define taskEXIT_CRITICAL_FROM_ISR(x)  ((void)(x))
+
+void *pvPortMalloc(size_t size);
+void vPortFree(void *p);
+
+#endif